@@ -356,6 +356,7 @@ HMM doit(const Data::Collection &all_data,
     cout << "Model after initialization = " << hmm << endl;
 
   hmm.switch_intermediate(options.store_intermediate);
+  hmm.set_checkpoint_memory(options.checkpoint_memory);
 
   // train background
   if (n_loaded == 0 and not options.objectives.empty()) {
@@ -406,7 +407,9 @@ HMM doit(const Data::Collection &all_data,
     if (options.verbosity >= Verbosity::info)
       cout << "Determining seeds automatically." << endl;
 
-    Seeding::Collection collection(training_data);
+    // the seeding collection is moved into plasma rather than copied
+    Seeding::Plasma plasma(Seeding::Collection(training_data),
+                           options.seeding);
 
     if (options.verbosity >= Verbosity::debug) {
       for (auto &contrast : training_data)
@@ -416,7 +419,7 @@ HMM doit(const Data::Collection &all_data,
             cerr << " " << m;
           cerr << endl;
         }
-      for (auto &contrast : collection)
+      for (auto &contrast : plasma.collection)
         for (auto &dataset : contrast) {
           cerr << "Seeding::Contrast " << contrast.name << " set -> motifs:";
           for (auto &m : dataset.motifs)
@@ -425,8 +428,6 @@ HMM doit(const Data::Collection &all_data,
         }
     }
 
-    Seeding::Plasma plasma(collection, options.seeding);
-
     if (options.verbosity >= Verbosity::debug)
       cout << "motif_specs.size() = "
            << plasma.options.motif_specifications.size() << endl;
@@ -767,7 +768,12 @@ void perform_analysis(Options::HMM &options, mt19937 &rng) {
   if (options.verbosity >= Verbosity::verbose)
     cout << "Loading sequences." << endl;
 
+  Timer timer;
   Data::Collection collection(options.paths, options.revcomp, options.n_seq);
+  double time = timer.tock();
+  if (options.timing_information)
+    cerr << "Loading sequences: " + time_to_pretty_string(time) << endl;
+
   if (not options.dont_save_shuffle_sequences) {
     auto paths = collection.save_shuffle_sequences(options.label);
     if (options.verbosity >= Verbosity::info)
@@ -51,13 +51,15 @@ void prepare_cross_validation(const Data::Contrast &contrast,
         if (p >= cross_validation_freq) {
           test.sequences.push_back(seq);
           test.set_size += 1;
-          test.seq_size += seq.sequence.size();
+          test.seq_size += seq.size();
         } else {
           training.sequences.push_back(seq);
           training.set_size += 1;
-          training.seq_size += seq.sequence.size();
+          training.seq_size += seq.size();
         }
       }
+      training.sort_by_length();
+      test.sort_by_length();
       if (verbosity >= Verbosity::verbose) {
         cerr << "Training data set size of " << dataset.path << " = "
              << training.set_size << endl;
@@ -99,3 +101,44 @@ void prepare_cross_validation(const Data::Collection &collection,
     test_data.set_size += test.set_size;
   }
 }
+
+Data::Collection sample_mini_batch(const Data::Collection &collection,
+                                   size_t batch_size, mt19937 &rng) {
+  const double fraction
+      = collection.set_size > 0
+            ? min<double>(1, 1.0 * batch_size / collection.set_size)
+            : 1;
+  Data::Collection batch;
+  for (auto &contrast : collection) {
+    Data::Contrast sub;
+    sub.name = contrast.name;
+    for (auto &dataset : contrast) {
+      Data::Set sample;
+      static_cast<Specification::Set &>(sample) = dataset;
+      sample.sha1 = dataset.sha1;
+
+      const size_t n = dataset.sequences.size();
+      const size_t k = min<size_t>(n, max<double>(1, round(fraction * n)));
+      // partial Fisher-Yates shuffle of the sequence indices
+      vector<size_t> idx(n);
+      iota(begin(idx), end(idx), 0);
+      for (size_t i = 0; i < k; i++) {
+        uniform_int_distribution<size_t> dist(i, n - 1);
+        swap(idx[i], idx[dist(rng)]);
+        auto &seq = dataset.sequences[idx[i]];
+        sample.sequences.push_back(seq);
+        sample.seq_size += seq.size();
+      }
+      sample.set_size = sample.sequences.size();
+      sample.sort_by_length();
+
+      sub.sets.push_back(sample);
+      sub.seq_size += sample.seq_size;
+      sub.set_size += sample.set_size;
+    }
+    batch.contrasts.push_back(sub);
+    batch.seq_size += sub.seq_size;
+    batch.set_size += sub.set_size;
+  }
+  return batch;
+}
@@ -52,4 +52,10 @@ void prepare_cross_validation(const Data::Collection &col,
                               std::mt19937 &rng,
                               Verbosity verbosity);
 
+/** Draw a mini-batch of about batch_size sequences, sampling without
+ * replacement from each data set in proportion to its size, so that the
+ * relative sizes of the data sets are preserved */
+Data::Collection sample_mini_batch(const Data::Collection &col,
+                                   size_t batch_size, std::mt19937 &rng);
+
 #endif
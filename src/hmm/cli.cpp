@@ -53,6 +53,7 @@ void gen_discrover_cli(size_t cols, string &config_path, Options::HMM &options,
   po::options_description mmie_options("MMIE options", cols);
   po::options_description linesearching_options("Line searching options", cols);
   po::options_description sampling_options("MCMC optimization options", cols);
+  po::options_description stochastic_options("Stochastic gradient options", cols);
   po::options_description termination_options("Termination options", cols);
 
   po::options_description seeding_options = gen_plasma_options_description(
@@ -193,6 +194,7 @@ void gen_discrover_cli(size_t cols, string &config_path, Options::HMM &options,
     ("cv", po::value(&options.cross_validation_iterations)->default_value(0), "Number of cross validation iterations to do.")
     ("cv_freq", po::value(&options.cross_validation_freq)->default_value(0.9, "0.9"), "Fraction of data samples for training in cross validation.")
     ("nseq", po::value(&options.n_seq)->default_value(0), "Use only the first N sequences of each file. Use 0 to indicate all sequences.")
+    ("cache", po::value(&options.cache_directory), "Directory in which to cache parsed FASTA files. Subsequent runs on the same files, with the same --revcomp and --nseq settings, load the cached sequences instead of parsing the files. For files with shuffles or characters other than ACGTU, cached sequences are only used with the same --salt. The suffix indices used for seeding are cached there as well.")
     ("iter", po::value(&options.termination.max_iter)->default_value(1000), "Maximal number of iterations to perform in training. A value of 0 means no limit, and that the training is only terminated by the tolerance.")
     ("salt", po::value(&options.random_salt), "Seed for the pseudo random number generator (used e.g. for sequence shuffle generation and MCMC sampling). Set this to get reproducible results.")
     ("weight", po::bool_switch(&options.weighting), "When combining objective functions across multiple contrasts, combine values by weighting with the number of sequences per contrasts.")
@@ -205,9 +207,11 @@ void gen_discrover_cli(size_t cols, string &config_path, Options::HMM &options,
      "fr   \tFletcher-Reeves\n"
      "pr   \tPolak-Ribière\n"
      "hs   \tHestenes-Stiefel\n"
-     "dy   \tDai-Yuan")
+     "dy   \tDai-Yuan\n"
+     "lbfgs\tLimited-memory BFGS")
     ("cg_iter", po::value(&options.conjugate.restart_iteration)->default_value(0), "Number of iterations after which to reset conjugate gradient. Use 0 to never reset.")
     ("cg_thresh", po::value(&options.conjugate.restart_threshold)->default_value(0), "Threshold for gradient orthogonality (between 0 and 1) below which the conjugate gradient will be reset. Use 0 to never reset.")
+    ("cg_mem", po::value(&options.conjugate.memory)->default_value(5), "Number of past iterations whose parameter and gradient changes are used by L-BFGS.")
     ;
 
   init_options.add_options()
@@ -256,6 +260,7 @@ void gen_discrover_cli(size_t cols, string &config_path, Options::HMM &options,
     ("LSeta", po::value(&options.line_search.eta)->default_value(0.5, "0.5"), "The parameter η for the Moré-Thuente line search algorithm.")
     ("LSdelta", po::value(&options.line_search.delta)->default_value(0.66, "0.66"), "The parameter delta for the Moré-Thuente line search algorithm.")
     ("LSnum", po::value(&options.line_search.max_steps)->default_value(10, "10"), "How many gradient and function evaluation to perform maximally per line search.")
+    ("LSconc", po::value(&options.line_search.concurrent_steps)->default_value(0, "0"), "How many step lengths around the previously accepted one to evaluate concurrently at the start of each line search. The best one fulfilling the Moré-Thuente conditions is accepted; if there is none, the sequential search follows. Values of 0 and 1 disable this.")
     ;
 
   termination_options.add_options()
@@ -275,6 +280,13 @@ void gen_discrover_cli(size_t cols, string &config_path, Options::HMM &options,
     ("nshift", po::value(&options.sampling.n_shift)->default_value(5), "Maximal number of positions that the motif may be shifted by.")
     ;
 
+  stochastic_options.add_options()
+    ("sgd", po::bool_switch(&options.stochastic.do_stochastic), "Perform gradient learning on mini-batches of sequences with adaptive step lengths (Adam) instead of line searches on all sequences. Useful for very large data sets. Each iteration consists of a number of mini-batch steps, after which the full objective is evaluated for the termination criteria.")
+    ("sgd_batch", po::value(&options.stochastic.batch_size)->default_value(1000), "Number of sequences per mini-batch. The sequences are sampled from each data set in proportion to its size.")
+    ("sgd_steps", po::value(&options.stochastic.n_steps)->default_value(50), "Number of mini-batch steps per iteration, i.e. between evaluations of the full objective.")
+    ("sgd_rate", po::value(&options.stochastic.learning_rate)->default_value(0.01, "0.01"), "Learning rate; the approximate magnitude of the change of the log-transformed parameters per mini-batch step.")
+    ;
+
   hidden_options.add_options()
     ("nosave", po::bool_switch(&options.dont_save_shuffle_sequences), "Do not save generated shuffle sequences.")
     ("bglearn", po::value(&options.bg_learning)->default_value(Training::Method::Reestimation, "em"), "How to learn the background. Available are 'fixed', 'em', 'gradient', where the 'em' uses re-estimation to maximize the likelihood contribution of the background parameters, while 'gradient' uses the discriminative objective function.")
@@ -285,6 +297,7 @@ void gen_discrover_cli(size_t cols, string &config_path, Options::HMM &options,
     ("miseeding", po::bool_switch(&options.use_mi_to_seed), "Disregard automatic seeding choice and use MICO for seeding.")
     ("absthresh", po::bool_switch(&options.termination.absolute_improvement), "Whether improvement should be gauged by absolute value. Default is relative to the current score.")
     ("intermediate", po::bool_switch(&options.store_intermediate), "Write out intermediate parameters during training.")
+    ("checkpoint", po::value<size_t>(&options.checkpoint_memory)->default_value(512), "Memory limit in MB for the dynamic programming tables of a single sequence. Longer sequences are processed with checkpointed forward-backward and Viterbi algorithms that store only every sqrt(L)-th row and recompute the others. Use 0 to never checkpoint.")
     ("limitlogp", po::bool_switch(&options.limit_logp), "Do not report corrected log-P values greater 0 but report 0 in this case.")
     ;
 
@@ -292,7 +305,8 @@ void gen_discrover_cli(size_t cols, string &config_path, Options::HMM &options,
     .add(conjugate_options)
     .add(multi_motif_options)
     .add(mmie_options)
-    .add(sampling_options);
+    .add(sampling_options)
+    .add(stochastic_options);
 
   hidden_options
     .add(linesearching_options)
@@ -26,7 +26,7 @@ ConditionalDecoder::ConditionalDecoder(const HMM &hmm_) : hmm(hmm_) {
 };
 
 void ConditionalDecoder::decode(std::ostream &os, const Data::Seq &seq) const {
-  const size_t n = seq.sequence.size();
+  const size_t n = seq.size();
   for (auto &group : emission_matrices)
     for (auto &matrix : group.second) {
       // TODO: handle indels in the motifs
@@ -35,8 +35,11 @@ void ConditionalDecoder::decode(std::ostream &os, const Data::Seq &seq) const {
       const size_t w = matrix.size1();
       for (size_t i = 0; i < n - w + 1; ++i) {
         double p = 1;
-        for (size_t j = 0; j < w; ++j)
-          p *= matrix(j, seq.isequence(i + j));
+        for (size_t j = 0; j < w; ++j) {
+          size_t symbol = seq.symbol(i + j);
+          // windows spanning the junction of the strands match nothing
+          p *= symbol == Data::Seq::empty_symbol ? 0 : matrix(j, symbol);
+        }
         os << " " << p;
       }
       for (size_t i = 1; i < w; ++i)
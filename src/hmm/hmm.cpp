@@ -49,6 +49,7 @@ Exception::HMM::Insertions::NotInsideMotif::NotInsideMotif()
 HMM::HMM(const string &path, Verbosity verbosity_, double pseudo_count)
     : verbosity(verbosity_),
       store_intermediate(false),
+      checkpoint_memory(default_checkpoint_memory),
       last_state(0),
       n_states(0),
       pseudo_count(pseudo_count),
@@ -58,6 +59,9 @@ HMM::HMM(const string &path, Verbosity verbosity_, double pseudo_count)
       emission(),
       pred(),
       succ(),
+      trans_to(),
+      trans_from(),
+      log_emission(),
       registration() {
   if (verbosity >= Verbosity::debug)
     cout << "Called HMM constructor 1." << endl;
@@ -79,6 +83,7 @@ HMM::HMM(const string &path, Verbosity verbosity_, double pseudo_count)
 HMM::HMM(const HMM &hmm, bool copy_deep)
     : verbosity(hmm.verbosity),
       store_intermediate(hmm.store_intermediate),
+      checkpoint_memory(hmm.checkpoint_memory),
       last_state(hmm.last_state),
       n_states(hmm.n_states),
       pseudo_count(hmm.pseudo_count),
@@ -88,6 +93,9 @@ HMM::HMM(const HMM &hmm, bool copy_deep)
       emission(hmm.emission),
       pred(hmm.pred),
       succ(hmm.succ),
+      trans_to(hmm.trans_to),
+      trans_from(hmm.trans_from),
+      log_emission(hmm.log_emission),
       registration(hmm.registration) {
   if (verbosity >= Verbosity::debug)
     cout << "Called HMM constructor 2." << endl;
@@ -97,6 +105,7 @@ HMM::HMM(const HMM &hmm, bool copy_deep)
 HMM::HMM(Verbosity verbosity_, double pseudo_count_)
     : verbosity(verbosity_),
       store_intermediate(false),
+      checkpoint_memory(default_checkpoint_memory),
       last_state(1),
       n_states(2),  // for the start state and background
       pseudo_count(pseudo_count_),
@@ -106,6 +115,9 @@ HMM::HMM(Verbosity verbosity_, double pseudo_count_)
       emission(zero_matrix(n_states, n_emissions)),
       pred(),
       succ(),
+      trans_to(),
+      trans_from(),
+      log_emission(),
       registration() {
   if (verbosity >= Verbosity::debug)
     cout << "Called HMM constructor 3." << endl;
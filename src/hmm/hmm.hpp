@@ -72,13 +72,17 @@
 
 #include <boost/container/map.hpp>
 #include <boost/container/flat_map.hpp>
+#include <deque>
+#include <functional>
 #include <list>
+#include <memory>
 #include <unordered_map>
 #include "association.hpp"
 #include "results.hpp"
 #include "hmm_options.hpp"
 #include "bitmask.hpp"
 #include "registration.hpp"
+#include "schedule.hpp"
 #include "../verbosity.hpp"
 
 struct Gradient {
@@ -116,6 +120,30 @@ inline double dderiv(const Gradient &direction, const Gradient &gradient) {
   return scalar_product(direction, gradient);
 }
 
+/** Memory of the limited-memory BFGS method */
+struct LBFGSMemory {
+  /** Transformed parameters when the last direction was computed, and after
+   * the subsequent line search */
+  Gradient start, accepted;
+  /** Differences of the parameters and of the negated gradients of the most
+   * recent iterations, oldest first */
+  std::deque<std::pair<Gradient, Gradient>> pairs;
+};
+
+/** State of stochastic gradient training that persists across iterations */
+struct StochasticState {
+  StochasticState(unsigned int seed)
+      : rng(seed), first_moment(), second_moment(), n_steps(0){};
+  /** Source of randomness for drawing the mini-batches */
+  std::mt19937 rng;
+  /** Moving averages of the mini-batch gradients and of their squares */
+  Gradient first_moment, second_moment;
+  /** Number of mini-batch steps taken with the current moments */
+  size_t n_steps;
+};
+
+class SubHMM;
+
 struct Group {
   enum class Kind { Special, Background, Motif };
   Kind kind;
@@ -142,6 +170,13 @@ protected:
   Verbosity verbosity;
   /** Whether to save intermediate parameters on disc during learning. */
   bool store_intermediate;
+  /** Memory limit in MB for the dynamic programming tables of a single
+   * sequence, beyond which checkpointing is used; 0 means no limit. */
+  size_t checkpoint_memory;
+  /** Sub-models without the states of the motifs in a presence mask; built
+   * on demand, and discarded whenever the parameters are recompiled. */
+  mutable std::unordered_map<bitmask_t, std::shared_ptr<const SubHMM>>
+      sub_models;
   /** The index of the start state. */
   static const size_t start_state = 0;
   /** The index of the bg state. */
@@ -169,6 +204,24 @@ protected:
   /** The indices of the successors of each state. */
   std::vector<std::vector<size_t>> succ;
 
+  /** Compressed sparse row layout of the transition matrix.
+   *  The edges of row i are stored at positions offset[i] up to, but
+   *  excluding, offset[i+1] of index and prob. */
+  struct SparseTransitions {
+    std::vector<size_t> offset;
+    std::vector<size_t> index;
+    std::vector<double> prob;
+    std::vector<double> log_prob;
+    /** The largest number of edges in any row */
+    size_t max_degree;
+  };
+  /** Transitions by destination; the indices are those of the predecessors. */
+  SparseTransitions trans_to;
+  /** Transitions by source; the indices are those of the successors. */
+  SparseTransitions trans_from;
+  /** The logarithms of the emission probabilities. */
+  matrix_t log_emission;
+
   Registration registration;
 
   // -------------------------------------------------------------------------------------------
@@ -190,6 +243,13 @@ protected:
   /** Initialize the predecessor and successor data structures */
   void initialize_pred_succ();
 
+  /** Build the sparse transition layouts from pred, succ, and the transition
+   * probabilities. Must be called whenever transition probabilities change. */
+  void compile_transitions();
+  /** Compute the log emission table. Must be called whenever emission
+   * probabilities change. */
+  void compile_emissions();
+
   /** Initialize the predecessor and successor data structures, and check
    * parameter consistency */
   void finalize_initialization();
@@ -239,7 +299,8 @@ protected:
                                   Training::State &ts,
                                   Gradient &prev_gradient,
                                   Gradient &prev_conjugate,
-                                  size_t &cg_niter);
+                                  size_t &cg_niter, LBFGSMemory &lbfgs,
+                                  StochasticState &sgd);
   /** Perform one iteration of gradient training. */
   bool perform_training_iteration_gradient(const Data::Collection &col,
                                            const Training::Task &task,
@@ -247,7 +308,16 @@ protected:
                                            int &center, double &score,
                                            Gradient &prev_gradient,
                                            Gradient &prev_conjugate,
-                                           size_t &cg_niter);
+                                           size_t &cg_niter,
+                                           LBFGSMemory &lbfgs);
+  /** Perform one iteration of stochastic gradient training: a number of
+   * adaptive steps on mini-batches, followed by an evaluation of the full
+   * objective. */
+  bool perform_training_iteration_stochastic(const Data::Collection &col,
+                                             const Training::Task &task,
+                                             const Options::HMM &options,
+                                             double &score,
+                                             StochasticState &sgd);
   /** Perform one iteration of re-estimation training. */
   bool perform_training_iteration_reestimation(const Data::Collection &col,
                                                const Training::Task &task,
@@ -364,17 +434,18 @@ public:
   double viterbi(const Data::Seq &s, StatePath &path) const;
   posterior_t posterior_atleast_one(const Data::Seq &seq,
                                     bitmask_t present) const;
+  /** Like the above, but for a given sub-model without the motif states; both
+   * likelihoods are computed in a single forward sweep. */
+  posterior_t posterior_atleast_one(const Data::Seq &seq,
+                                    const SubHMM &subhmm) const;
   double expected_posterior(const Data::Seq &seq, bitmask_t present) const;
 
 protected:
   vector_t posterior_atleast_one(const Data::Set &dataset,
                                  bitmask_t present) const;
-  double sum_posterior_atleast_one(const Data::Set &dataset,
-                                   bitmask_t present) const;
 
   vector_t expected_posterior(const Data::Contrast &contrast,
                               bitmask_t present) const;
-  double expected_posterior(const Data::Set &dataset, bitmask_t present) const;
 
 public:
   // posterior statistics of pairs of motifs
@@ -396,9 +467,10 @@ protected:
   pair_posteriors_t pair_posterior_atleast_one(const Data::Set &dataset,
                                                bitmask_t present,
                                                bitmask_t previous) const;
-  pair_posterior_t sum_pair_posterior_atleast_one(const Data::Set &dataset,
-                                                  bitmask_t present,
-                                                  bitmask_t previous) const;
+  /** Pair posteriors of a single sequence, given the variant indicator
+   * matrix of the full model and the models without either or both motifs */
+  pair_posterior_t pair_posterior_atleast_one(const Data::Seq &seq,
+                                              const matrix_t &keep) const;
 
   // -------------------------------------------------------------------------------------------
   // Generative and discriminative measures
@@ -414,11 +486,12 @@ public:
   double log_likelihood(const Data::Collection &col) const;
   double log_likelihood(const Data::Contrast &contrast) const;
   double log_likelihood(const Data::Set &s) const;
+  /** Log-likelihoods of several data sets, computed in a single loop over all
+   * their sequences */
+  std::vector<double> log_likelihoods(const Schedule::Sets &sets) const;
 
   double class_likelihood(const Data::Contrast &contrast, bitmask_t present,
                           bool compute_posterior) const;
-  double class_likelihood(const Data::Set &dataset, bitmask_t present,
-                          bool compute_posterior) const;
 
   // TODO make protected
   // protected:
@@ -493,11 +566,30 @@ protected:
   double ViterbiIteration(matrix_t &T, matrix_t &E, const Data::Set &dataset,
                           const Training::Targets &targets,
                           const Options::HMM &options);
-
-  double BaumWelchIteration(matrix_t &T, matrix_t &E, const Data::Seq &s,
+  /** Perform one iteration of scaled Baum-Welch learning for several data
+   * sets, in a single loop over all their sequences */
+  double BaumWelchIteration(matrix_t &T, matrix_t &E,
+                            const Schedule::Sets &sets,
                             const Training::Targets &targets) const;
+  /** Perform one iteration of Viterbi learning for several data sets, in a
+   * single loop over all their sequences */
+  double ViterbiIteration(matrix_t &T, matrix_t &E, const Schedule::Sets &sets,
+                          const Training::Targets &targets);
+
   double BaumWelchIteration_single(matrix_t &T, matrix_t &E, const Data::Seq &s,
                                    const Training::Targets &targets) const;
+  /** Like BaumWelchIteration_single, but storing only every sqrt(L)-th row of
+   * the forward matrix and recomputing the rows in between when needed. */
+  double BaumWelchIteration_checkpointed(
+      matrix_t &T, matrix_t &E, const Data::Seq &s,
+      const Training::Targets &targets) const;
+  /** Expected counts for this model and for the sub-model subhmm, computed in
+   * one forward-backward sweep. The sub-model's counts T_r and E_r are
+   * indexed by the states of this model, i.e. they are already lifted. */
+  double BaumWelchIteration_pair(matrix_t &T, matrix_t &E, matrix_t &T_r,
+                                 matrix_t &E_r, double &log_likel_r,
+                                 const Data::Seq &s, const SubHMM &subhmm,
+                                 const Training::Targets &targets) const;
 
   // -------------------------------------------------------------------------------------------
   // Monte-Carlo Markov Chain inference
@@ -523,6 +615,12 @@ protected:
   std::pair<double, HMM> line_search_more_thuente(
       const Data::Collection &col, const Gradient &gradient, double score,
       int &info, const Training::Task &task, const Options::HMM &options) const;
+  /** Perform gradient line searching by evaluating several step lengths
+   * around 2^center concurrently; info is 1 if one of them is acceptable */
+  std::pair<double, HMM> line_search_speculative(
+      const Data::Collection &col, const Gradient &gradient, double score,
+      int &info, const Training::Task &task, const Options::HMM &options,
+      int &center) const;
   /** Auxiliary routine to build candidate HMM for a step in a given direction
    * and a given step size. */
   HMM build_trial_model(const Gradient &gradient, double alpha,
@@ -541,11 +639,122 @@ protected:
   // calculation
   // -------------------------------------------------------------------------------------------
 
+  /** Scratch storage for the forward and backward algorithms.
+   *  The buffers only ever grow, to fit the longest sequence and the largest
+   *  model seen so far, so that repeated use does not allocate memory.
+   *  Rows and columns beyond the current sequence and model are unused. */
+  struct Workspace {
+    vector_t scale;
+    matrix_t alpha;
+    matrix_t beta;
+    vector_t prev;
+    vector_t cur;
+    /** Tables of a sub-model computed alongside those above */
+    vector_t scale_r;
+    matrix_t alpha_r, beta_r;
+    vector_t prev_r, cur_r;
+    /** Scaling vectors, as columns, and forward rows of several model
+     * variants; the rows are stored state-major, with the variants of a
+     * state adjacent */
+    matrix_t batch_scale;
+    std::vector<double> batch_prev, batch_cur;
+    /** Viterbi back-pointers, as offsets into the predecessor lists, for
+     * each of the offset widths */
+    std::vector<uint8_t> traceback8;
+    std::vector<uint16_t> traceback16;
+    std::vector<uint32_t> traceback32;
+    /** Checkpointed rows, and the recomputed rows of one block */
+    matrix_t checkpoints, block;
+    /** Expected counts of the full and reduced models, the lifted reduced
+     * counts, and the corresponding gradients */
+    matrix_t T, E, Tr, Er, T_lifted, E_lifted, t, e, tr, er;
+    /** Ensure room for a sequence of length L and a model with n states */
+    void reserve(size_t L, size_t n);
+    /** Back-pointer storage for at least n offsets of type Offset */
+    template <typename Offset>
+    Offset *traceback(size_t n);
+    /** Set a matrix to zero, resizing it only if its dimensions differ */
+    static void reset(matrix_t &m, size_t size1, size_t size2);
+    /** Ensure a matrix has at least the given dimensions */
+    static void grow(matrix_t &m, size_t size1, size_t size2);
+  };
+  /** The workspace of the calling thread */
+  static Workspace &workspace();
+
+  /** Viterbi algorithm storing back-pointers as Offset-typed indices into the
+   * predecessor lists; Offset must be wide enough for trans_to.max_degree. */
+  template <typename Offset>
+  double viterbi(const Data::Seq &s, StatePath &path, Workspace &ws) const;
+  /** Viterbi algorithm storing only every sqrt(L)-th column of scores, and
+   * back-pointers for one block of columns at a time. */
+  template <typename Offset>
+  double viterbi_checkpointed(const Data::Seq &s, StatePath &path,
+                              Workspace &ws) const;
+  /** One step of the Viterbi recursion, computing scores cur from prev */
+  template <typename Offset>
+  void viterbi_step(size_t symbol, const double *prev, double *cur,
+                    Offset *traceback) const;
+
+  /** Whether dynamic programming tables of the given size in bytes are to be
+   * replaced by checkpointing */
+  bool use_checkpointing(size_t bytes) const;
+  /** Number of rows per block when checkpointing over n rows */
+  static size_t checkpoint_block_size(size_t n);
+
+  /** One step of the forward recursion, computing row cur from row prev.
+   * Returns the scaling factor; cur is left unscaled. */
+  double forward_step(size_t symbol, const double *prev, double *cur) const;
+  /** Scale a row computed by forward_step */
+  void scale_forward_step(size_t symbol, double scale, double *cur) const;
+  /** One step of the pre-scaled backward recursion, computing row cur from
+   * row next. */
+  void backward_step(size_t symbol, double scale, const double *next,
+                     double *cur) const;
+  /** Forward step for this model and, alongside, for the sub-model of the
+   * states with reduce[i] != -1; the rows of the sub-model are indexed by the
+   * states of this model and are zero for the states not in the sub-model. */
+  void forward_step_pair(size_t symbol, const std::vector<int> &reduce,
+                         const double *prev, const double *prev_r, double *cur,
+                         double *cur_r, double &scale, double &scale_r) const;
+  /** Backward step for this model and for a sub-model, like forward_step_pair
+   */
+  void backward_step_pair(size_t symbol, const std::vector<int> &reduce,
+                          double scale, double scale_r, const double *next,
+                          const double *next_r, double *cur,
+                          double *cur_r) const;
+
   /** The standard forward algorithm with scaling.
    *  The scaling vector is also determined. */
   matrix_t compute_forward_scaled(const Data::Seq &s, vector_t &scale) const;
   /** Computes only the scaling vector of the standard forward algorithm with scaling. */
   vector_t compute_forward_scale(const Data::Seq &s) const;
+  /** The log likelihood of a sequence, computed with the scaled forward
+   * algorithm in the calling thread's workspace. */
+  double log_likelihood(const Data::Seq &s) const;
+
+  /** Scaled forward algorithm writing into the first T+2 rows of m and scale,
+   * which must be large enough. */
+  void forward_scaled(const Data::Seq &s, matrix_t &m, vector_t &scale) const;
+  /** Scaling vector of the scaled forward algorithm, using the buffers of ws.
+   * The first T+2 entries of scale are written, which must be large enough. */
+  void forward_scale(const Data::Seq &s, vector_t &scale, Workspace &ws) const;
+  /** Indicator matrix of the states (rows) kept in each of the model variants
+   * (columns) without the motifs in the corresponding entry of absent; a mask
+   * of 0 denotes the full model. */
+  matrix_t variant_states(const std::vector<bitmask_t> &absent) const;
+  /** Scaling vectors of the scaled forward algorithm for all model variants
+   * given by the columns of keep, computed in one sweep over the sequence.
+   * Column v of the first T+2 rows of ws.batch_scale holds variant v's. */
+  void forward_scale_batch(const Data::Seq &s, const matrix_t &keep,
+                           Workspace &ws) const;
+  /** Log likelihoods of a sequence under all model variants given by the
+   * columns of keep, computed with forward_scale_batch. */
+  void log_likelihood_batch(const Data::Seq &s, const matrix_t &keep,
+                            vector_t &logp) const;
+  /** Pre-scaled backward algorithm writing into the first T+2 rows of m,
+   * which must be large enough. */
+  void backward_prescaled(const Data::Seq &s, const vector_t &scale,
+                          matrix_t &m) const;
 
   /** The standard forward algorithm with pre-scaling.
    *  The scaling vector is assumed to be given. */
@@ -558,10 +767,22 @@ protected:
 
   double likelihood_from_scale(const vector_t &scale) const;
   double log_likelihood_from_scale(const vector_t &scale) const;
-
-  double expected_state_posterior(size_t k, const matrix_t &f,
-                                  const matrix_t &b,
-                                  const vector_t &scale) const;
+  /** Log likelihood from the first n entries of the scaling vector. */
+  double log_likelihood_from_scale(const vector_t &scale, size_t n) const;
+
+  /** Posteriors of the given states at the positions 0 to L + 1 of a
+   * sequence; those of position i, in the order of states, are passed to
+   * visit(i, posteriors). The positions are visited in increasing order,
+   * unless the forward and backward tables exceed the checkpointing limit:
+   * then only every sqrt(L)-th forward row is stored, and the others are
+   * recomputed block by block while the positions are visited in
+   * decreasing order. */
+  void state_posteriors(
+      const Data::Seq &s, const std::vector<size_t> &states,
+      const std::function<void(size_t, const double *)> &visit) const;
+  /** Expected numbers of positions of a sequence in each of the given states */
+  std::vector<double> expected_state_posteriors(
+      const Data::Seq &s, const std::vector<size_t> &states) const;
 
   // -------------------------------------------------------------------------------------------
   // Gradient methods
@@ -571,11 +792,12 @@ protected:
   // -------------------------------------------------------------------------------------------
 
   /** Likelihood gradient w.r.t. transformed transition and emission
-   * probabilities */
-  double log_likelihood_gradient(const Data::Seqs &s,
-                                 const Training::Targets &targets,
-                                 matrix_t &transition_g,
-                                 matrix_t &emission_g) const;
+   * probabilities, for each of several data sets, computed in a single loop
+   * over all their sequences */
+  std::vector<double> log_likelihood_gradient(
+      const Schedule::Sets &sets, const Training::Targets &targets,
+      std::vector<matrix_t> &transition_g,
+      std::vector<matrix_t> &emission_g) const;
 
   /** Gradient of mutual information of class and motif occurrence w.r.t.
    * transformed transition and emission probabilities */
@@ -588,9 +810,12 @@ protected:
   double rank_information_gradient(const Data::Contrast &contrast,
                                    const Training::Task &task,
                                    bitmask_t present, Gradient &g) const;
-  double rank_information_gradient(const Data::Set &dataset,
-                                   const Training::Task &task,
-                                   bitmask_t present, Gradient &g) const;
+  /** Rank information gradient of one data set, given the expected
+   * occurrences and posterior gradients of its sequences */
+  double rank_information_gradient(
+      const Data::Set &dataset,
+      const std::vector<std::pair<double, Gradient>> &results,
+      const Training::Task &task, Gradient &g) const;
 
   /** Gradient of Matthew's correlation coefficient of class and motif
    * occurrence w.r.t. transformed transition and emission probabilities */
@@ -623,28 +848,39 @@ protected:
   double class_likelihood_gradient(const Data::Contrast &contrast,
                                    const Training::Task &task,
                                    bitmask_t present, Gradient &g) const;
-  double class_likelihood_gradient(const Data::Set &dataset,
-                                   const Training::Task &task,
-                                   bitmask_t present, Gradient &g) const;
 
   /** Gradient of the expected posterior probability of having at least one site
-   * w.r.t. transformed transition and emission probabilities */
-  posterior_t posterior_gradient(const Data::Set &s, const Training::Task &task,
-                                 bitmask_t present, matrix_t &transition_g,
-                                 matrix_t &emission_g) const;
+   * w.r.t. transformed transition and emission probabilities, for each data
+   * set of a contrast, computed in a single loop over all their sequences */
+  std::vector<posterior_t> posterior_gradient(
+      const Data::Contrast &contrast, const Training::Task &task,
+      bitmask_t present, std::vector<matrix_t> &transition_g,
+      std::vector<matrix_t> &emission_g) const;
   posterior_gradient_t posterior_gradient(const Data::Seq &seq,
                                           const Training::Task &task,
                                           bitmask_t present,
                                           matrix_t &transition_g,
                                           matrix_t &emission_g) const;
+  /** Accumulate the posterior gradient of a single sequence, multiplied by
+   * weight, given the reduced model lacking the present motifs. The expected
+   * counts of the full model are left in the calling thread's workspace. */
+  posterior_t posterior_gradient(const Data::Seq &seq, const SubHMM &subhmm,
+                                 const Training::Targets &targets,
+                                 const Training::Targets &reduced_targets,
+                                 matrix_t &transition_g, matrix_t &emission_g,
+                                 double weight = 1) const;
 
   /** (Log) likelihood gradient w.r.t. transformed transition probabilities */
   matrix_t transition_gradient(const matrix_t &T,
                                const Training::Range &allowed) const;
+  void transition_gradient(const matrix_t &T, const Training::Range &allowed,
+                           matrix_t &m) const;
 
   /** (Log) likelihood gradient w.r.t. transformed emission probabilities */
   matrix_t emission_gradient(const matrix_t &E,
                              const Training::Range &allowed) const;
+  void emission_gradient(const matrix_t &E, const Training::Range &allowed,
+                         matrix_t &m) const;
 
 public:
   std::pair<HMM, std::map<size_t, size_t>> add_revcomp_motifs() const;
@@ -666,6 +902,9 @@ public:
   bool check_consistency(double eps = 1e-6) const;
 
   void switch_intermediate(bool new_state) { store_intermediate = new_state; };
+  void set_checkpoint_memory(size_t mb) { checkpoint_memory = mb; };
+  /** Default for the checkpointing memory limit, in MB */
+  static const size_t default_checkpoint_memory = 512;
 
   mask_t compute_mask(const Data::Collection &col) const;
 
@@ -699,6 +938,9 @@ public:
 protected:
   Training::Range complementary_states(size_t group_idx) const;
   Training::Range complementary_states_mask(bitmask_t present) const;
+  /** The sub-model without the states of the motifs in present, from the
+   * cache of sub-models */
+  std::shared_ptr<const SubHMM> sub_model(bitmask_t present) const;
 };
 
 namespace Exception {
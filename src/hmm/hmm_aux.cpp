@@ -51,6 +51,7 @@ void HMM::shift_forward(size_t group_idx, size_t n) {
   for (size_t j = 0; j < n_emissions; j++)
     emission(*groups[group_idx].states.rbegin(), j) = 1.0 / n_emissions;
   normalize_emission(emission);
+  compile_emissions();
 }
 
 void HMM::shift_backward(size_t group_idx, size_t n) {
@@ -61,6 +62,7 @@ void HMM::shift_backward(size_t group_idx, size_t n) {
   for (size_t j = 0; j < n_emissions; j++)
     emission(*groups[group_idx].states.begin(), j) = 1.0 / n_emissions;
   normalize_emission(emission);
+  compile_emissions();
 }
 
 void HMM::serialize(ostream &os, const ExecutionInformation &exec_info,
@@ -727,6 +729,21 @@ Training::Range HMM::complementary_states_mask(bitmask_t present_mask) const {
   return range;
 }
 
+shared_ptr<const SubHMM> HMM::sub_model(bitmask_t present) const {
+  shared_ptr<const SubHMM> subhmm;
+#pragma omp critical(sub_models)
+  {
+    auto iter = sub_models.find(present);
+    if (iter == end(sub_models))
+      iter = sub_models.emplace(present,
+                                make_shared<SubHMM>(
+                                    *this, complementary_states_mask(present)))
+                 .first;
+    subhmm = iter->second;
+  }
+  return subhmm;
+}
+
 string HMM::get_group_consensus(const matrix_t &m, size_t idx, double threshold) const {
   const string iupac = "-acmgrsvtwyhkdbn";
   string gapped_consensus = "";
@@ -785,13 +802,12 @@ void HMM::print_occurrence_table_header(ostream &out) const {
 void HMM::print_occurrence_table(const string &file_path, const Data::Seq &seq,
                                  const StatePath &path, ostream &out,
                                  bool bed) const {
-  size_t seqlen = seq.sequence.size();
+  // with both strands, paths cover xxx$xxx, so their length is 2n + 1,
+  // and the middle symbol is $
+  const string sequence = seq.strands();
+  size_t seqlen = sequence.size();
   size_t midpoint = seqlen / 2;
-  bool revcomp = false;
-  // reverse-complementary sequences look like this: xxx$xxx
-  // so their length is 2n + 1, and the middle nucleotide is $
-  if (seqlen % 2 == 1 and seq.sequence[midpoint] == '$')
-    revcomp = true;
+  bool revcomp = seq.both_strands;
 
   double center;
   if (revcomp)
@@ -806,7 +822,7 @@ void HMM::print_occurrence_table(const string &file_path, const Data::Seq &seq,
         size_t end = pos + 1;
         while (end != path.size() and path[end] > path[pos])
           end++;
-        string motif = seq.sequence.substr(pos, end - pos);
+        string motif = sequence.substr(pos, end - pos);
 
         bool strand = (not revcomp) or (pos < midpoint);
         // forward_pos is the position relative to the forward strand
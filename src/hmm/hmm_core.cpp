@@ -27,160 +27,410 @@
  * =====================================================================================
  */
 
+#include <cstdint>
+#include <boost/numeric/ublas/matrix_proxy.hpp>
 #include <boost/range/adaptors.hpp>
 #include "../aux.hpp"
 #include "hmm.hpp"
 
 using namespace std;
 
+template <typename Offset>
+static Offset *grow_to(vector<Offset> &v, size_t n) {
+  if (v.size() < n)
+    v.resize(n);
+  return v.data();
+}
+
+template <>
+uint8_t *HMM::Workspace::traceback<uint8_t>(size_t n) {
+  return grow_to(traceback8, n);
+}
+
+template <>
+uint16_t *HMM::Workspace::traceback<uint16_t>(size_t n) {
+  return grow_to(traceback16, n);
+}
+
+template <>
+uint32_t *HMM::Workspace::traceback<uint32_t>(size_t n) {
+  return grow_to(traceback32, n);
+}
+
 double HMM::viterbi(const Data::Seq &s, StatePath &path) const {
-  // TODO: precompute log probabilities
-  size_t L = s.isequence.size();
+  Workspace &ws = workspace();
+  if (trans_to.max_degree <= numeric_limits<uint8_t>::max() + 1ul)
+    return viterbi<uint8_t>(s, path, ws);
+  else if (trans_to.max_degree <= numeric_limits<uint16_t>::max() + 1ul)
+    return viterbi<uint16_t>(s, path, ws);
+  else
+    return viterbi<uint32_t>(s, path, ws);
+}
 
-  vector_t v_current
-      = scalar_vector(n_states, -numeric_limits<double>::infinity());
-  vector_t v_previous
-      = scalar_vector(n_states, -numeric_limits<double>::infinity());
-  v_previous(start_state) = 0;
-  boost::numeric::ublas::matrix<size_t> traceback(L, n_states);
-  for (size_t i = 0; i < L; i++) {
-    size_t symbol = s.isequence(i);
-    if (symbol == empty_symbol)
-      for (size_t k = start_state; k < n_states; k++) {
-        double tmp = v_previous(k) + log(transition(k, start_state));
-        if (tmp > v_current(start_state)) {
-          v_current(start_state) = tmp;
-          traceback(i, start_state) = k;
-        }
+template <typename Offset>
+void HMM::viterbi_step(size_t symbol, const double *prev, double *cur,
+                       Offset *traceback) const {
+  const double neg_inf = -numeric_limits<double>::infinity();
+  const SparseTransitions &to = trans_to;
+  fill_n(cur, n_states, neg_inf);
+  if (symbol == empty_symbol) {
+    fill_n(traceback, n_states, 0);
+    for (size_t e = to.offset[start_state]; e < to.offset[start_state + 1];
+         e++) {
+      double tmp = prev[to.index[e]] + to.log_prob[e];
+      if (tmp > cur[start_state]) {
+        cur[start_state] = tmp;
+        traceback[start_state] = e - to.offset[start_state];
       }
-    else
-      for (size_t l = start_state; l < n_states; l++) {
-        double m = -numeric_limits<double>::infinity();
-        for (size_t k = start_state; k < n_states; k++) {
-          double tmp = v_previous(k) + log(transition(k, l));
-          if (tmp > m) {
-            m = tmp;
-            traceback(i, l) = k;
-          }
+    }
+  } else
+    for (size_t l = start_state; l < n_states; l++) {
+      double m = neg_inf;
+      Offset best = 0;
+      for (size_t e = to.offset[l]; e < to.offset[l + 1]; e++) {
+        double tmp = prev[to.index[e]] + to.log_prob[e];
+        if (tmp > m) {
+          m = tmp;
+          best = e - to.offset[l];
         }
-        v_current(l) = log(emission(l, symbol)) + m;
       }
-    v_previous = v_current;
-    v_current = scalar_vector(n_states, -numeric_limits<double>::infinity());
+      traceback[l] = best;
+      cur[l] = log_emission(l, symbol) + m;
+    }
+}
+
+template <typename Offset>
+double HMM::viterbi(const Data::Seq &s, StatePath &path, Workspace &ws) const {
+  const double neg_inf = -numeric_limits<double>::infinity();
+  const SparseTransitions &to = trans_to;
+  size_t L = s.size();
+
+  if (use_checkpointing(L * n_states * sizeof(Offset)))
+    return viterbi_checkpointed<Offset>(s, path, ws);
+
+  ws.reserve(0, n_states);
+  Offset *traceback = ws.traceback<Offset>(L * n_states);
+
+  vector_t &v_current = ws.cur;
+  vector_t &v_previous = ws.prev;
+  fill_n(v_previous.begin(), n_states, neg_inf);
+  v_previous(start_state) = 0;
+  for (size_t i = 0; i < L; i++) {
+    viterbi_step(s.symbol(i), &v_previous(0), &v_current(0),
+                 traceback + i * n_states);
+    v_previous.swap(v_current);
   }
 
-  double p = -numeric_limits<double>::infinity();
+  double p = neg_inf;
   size_t pi = 0;
-  for (size_t k = start_state; k < n_states; k++) {
-    double tmp = v_previous(k) + log(transition(k, start_state));
+  for (size_t e = to.offset[start_state]; e < to.offset[start_state + 1];
+       e++) {
+    double tmp = v_previous(to.index[e]) + to.log_prob[e];
     if (tmp > p) {
       p = tmp;
-      pi = k;
+      pi = to.index[e];
     }
   }
   path = StatePath(L);
   path(L - 1) = pi;
   for (size_t i = L - 1; i > 0; i--)
-    pi = path(i - 1) = traceback(i, pi);
+    pi = path(i - 1) = to.index[to.offset[pi] + traceback[i * n_states + pi]];
 
   return p;
 };
 
+template <typename Offset>
+double HMM::viterbi_checkpointed(const Data::Seq &s, StatePath &path,
+                                 Workspace &ws) const {
+  const double neg_inf = -numeric_limits<double>::infinity();
+  const SparseTransitions &to = trans_to;
+  size_t L = s.size();
+  size_t K = checkpoint_block_size(L);
+  size_t n_blocks = (L + K - 1) / K;
+
+  if (verbosity >= Verbosity::debug)
+    cout << "Checkpointed Viterbi for sequence of length " << L
+         << " with block size " << K << endl;
+
+  // checkpoint j holds the scores before position j * K
+  ws.reserve(0, n_states);
+  Workspace::grow(ws.checkpoints, n_blocks + 1, n_states);
+  Offset *traceback = ws.traceback<Offset>(K * n_states);
+
+  vector_t &v_current = ws.cur;
+  vector_t &v_previous = ws.prev;
+  fill_n(v_previous.begin(), n_states, neg_inf);
+  v_previous(start_state) = 0;
+  for (size_t i = 0; i < L; i++) {
+    if (i % K == 0)
+      copy_n(&v_previous(0), n_states, &ws.checkpoints(i / K, 0));
+    viterbi_step(s.symbol(i), &v_previous(0), &v_current(0), traceback);
+    v_previous.swap(v_current);
+  }
+
+  double p = neg_inf;
+  size_t pi = 0;
+  for (size_t e = to.offset[start_state]; e < to.offset[start_state + 1];
+       e++) {
+    double tmp = v_previous(to.index[e]) + to.log_prob[e];
+    if (tmp > p) {
+      p = tmp;
+      pi = to.index[e];
+    }
+  }
+  path = StatePath(L);
+  path(L - 1) = pi;
+
+  // recompute the back-pointers block by block, from the last to the first
+  for (size_t j = n_blocks; j-- > 0;) {
+    size_t first = j * K;
+    size_t last = min(first + K, L);
+    copy_n(&ws.checkpoints(j, 0), n_states, &v_previous(0));
+    for (size_t i = first; i < last; i++) {
+      viterbi_step(s.symbol(i), &v_previous(0), &v_current(0),
+                   traceback + (i - first) * n_states);
+      v_previous.swap(v_current);
+    }
+    for (size_t i = last - 1; i >= max<size_t>(first, 1); i--)
+      pi = path(i - 1)
+          = to.index[to.offset[pi] + traceback[(i - first) * n_states + pi]];
+  }
+
+  return p;
+};
+
+bool HMM::use_checkpointing(size_t bytes) const {
+  return checkpoint_memory > 0 and bytes > checkpoint_memory * 1024 * 1024;
+}
+
+size_t HMM::checkpoint_block_size(size_t n) {
+  return max<size_t>(1, ceil(sqrt(n)));
+}
+
+void HMM::Workspace::reserve(size_t L, size_t n) {
+  if (alpha.size1() < L + 2 or alpha.size2() < n) {
+    size_t rows = max<size_t>(alpha.size1(), L + 2);
+    size_t cols = max<size_t>(alpha.size2(), n);
+    alpha.resize(rows, cols, false);
+    beta.resize(rows, cols, false);
+  }
+  if (scale.size() < L + 2)
+    scale.resize(L + 2, false);
+  if (prev.size() < n) {
+    prev.resize(n, false);
+    cur.resize(n, false);
+    prev_r.resize(n, false);
+    cur_r.resize(n, false);
+  }
+}
+
+void HMM::Workspace::grow(matrix_t &m, size_t size1, size_t size2) {
+  if (m.size1() < size1 or m.size2() < size2)
+    m.resize(max(m.size1(), size1), max(m.size2(), size2), false);
+}
+
+void HMM::Workspace::reset(matrix_t &m, size_t size1, size_t size2) {
+  if (m.size1() != size1 or m.size2() != size2)
+    m.resize(size1, size2, false);
+  m.clear();
+}
+
+HMM::Workspace &HMM::workspace() {
+  static thread_local Workspace ws;
+  return ws;
+}
+
 vector_t HMM::compute_forward_scale(const Data::Seq &s) const {
-  size_t T = s.isequence.size();
-  vector_t scale = zero_vector(T + 2);
-  vector_t prev = zero_vector(n_states);
-  vector_t cur = zero_vector(n_states);
+  Workspace &ws = workspace();
+  ws.reserve(0, n_states);
+  vector_t scale(s.size() + 2);
+  forward_scale(s, scale, ws);
+  return scale;
+}
+
+double HMM::log_likelihood(const Data::Seq &s) const {
+  Workspace &ws = workspace();
+  size_t T = s.size();
+  ws.reserve(T, n_states);
+  forward_scale(s, ws.scale, ws);
+  return log_likelihood_from_scale(ws.scale, T + 2);
+}
+
+double HMM::forward_step(size_t symbol, const double *prev,
+                         double *cur) const {
+  const SparseTransitions &to = trans_to;
+  double scale = 0;
+  fill_n(cur, n_states, 0.0);
+  if (symbol == empty_symbol) {
+    for (size_t e = to.offset[start_state]; e < to.offset[start_state + 1];
+         e++)
+      cur[start_state] += prev[to.index[e]] * to.prob[e];
+    scale = cur[start_state];
+  } else
+    for (size_t i = 0; i < n_states; i++) {
+      double emission_i_t = emission(i, symbol);
+      if (emission_i_t > 0) {
+        for (size_t e = to.offset[i]; e < to.offset[i + 1]; e++)
+          cur[i] += prev[to.index[e]] * to.prob[e];
+        scale += cur[i] *= emission_i_t;
+      }
+    }
+  return scale;
+}
+
+void HMM::scale_forward_step(size_t symbol, double scale, double *cur) const {
+  if (symbol == empty_symbol)
+    cur[start_state] = 1;
+  else
+    for (size_t i = 0; i < n_states; i++)
+      cur[i] /= scale;
+}
+
+void HMM::forward_scale(const Data::Seq &s, vector_t &scale,
+                        Workspace &ws) const {
+  size_t T = s.size();
+  vector_t &prev = ws.prev;
+  vector_t &cur = ws.cur;
+  fill_n(prev.begin(), n_states, 0.0);
 
   prev(start_state) = 1;
   scale(0) = 1;
   for (size_t t = 0; t < T; t++) {
-    size_t symbol = s.isequence(t);
+    size_t symbol = s.symbol(t);
+    scale(t + 1) = forward_step(symbol, &prev(0), &cur(0));
+    scale_forward_step(symbol, scale(t + 1), &cur(0));
+    prev.swap(cur);
+  }
+
+  // the final transition to the start state is like that for an empty symbol
+  scale(T + 1) = forward_step(empty_symbol, &prev(0), &cur(0));
+}
+
+matrix_t HMM::variant_states(const vector<bitmask_t> &absent) const {
+  matrix_t keep(n_states, absent.size());
+  for (size_t i = 0; i < n_states; i++)
+    for (size_t v = 0; v < absent.size(); v++)
+      keep(i, v) = (absent[v] & bitmask_t(1 << group_ids[i])).none() ? 1 : 0;
+  return keep;
+}
+
+void HMM::forward_scale_batch(const Data::Seq &s, const matrix_t &keep,
+                              Workspace &ws) const {
+  size_t T = s.size();
+  size_t V = keep.size2();
+  const SparseTransitions &to = trans_to;
+  Workspace::grow(ws.batch_scale, T + 2, V);
+  vector<double> &prev = ws.batch_prev;
+  vector<double> &cur = ws.batch_cur;
+  prev.assign(n_states * V, 0.0);
+  cur.resize(n_states * V);
+
+  fill_n(&prev[start_state * V], V, 1.0);
+  fill_n(&ws.batch_scale(0, 0), V, 1.0);
+  // the final transition to the start state is like that for an empty symbol
+  for (size_t t = 0; t <= T; t++) {
+    size_t symbol = t < T ? s.symbol(t) : empty_symbol;
+    double *scale = &ws.batch_scale(t + 1, 0);
+    fill_n(scale, V, 0.0);
+    fill(begin(cur), end(cur), 0.0);
     if (symbol == empty_symbol) {
-      for (auto pre : pred[start_state])
-        cur(start_state) += prev(pre) * transition(pre, start_state);
-      scale(t + 1) = cur(start_state);
-      cur(start_state) = 1;
+      double *c = &cur[start_state * V];
+      for (size_t e = to.offset[start_state]; e < to.offset[start_state + 1];
+           e++) {
+        const double *p = &prev[to.index[e] * V];
+        for (size_t v = 0; v < V; v++)
+          c[v] += p[v] * to.prob[e];
+      }
+      for (size_t v = 0; v < V; v++)
+        scale[v] = c[v];
+      fill(begin(cur), end(cur), 0.0);
+      fill_n(c, V, 1.0);
     } else {
+      // the symbol, emission and transitions are shared by the variants;
+      // states missing in a variant are zeroed by their weight in keep
       for (size_t i = 0; i < n_states; i++) {
         double emission_i_t = emission(i, symbol);
         if (emission_i_t > 0) {
-          for (auto pre : pred[i])
-            cur(i) += prev(pre) * transition(pre, i);
-          cur(i) *= emission_i_t;
-          scale(t + 1) += cur(i);
+          double *c = &cur[i * V];
+          for (size_t e = to.offset[i]; e < to.offset[i + 1]; e++) {
+            const double *p = &prev[to.index[e] * V];
+            for (size_t v = 0; v < V; v++)
+              c[v] += p[v] * to.prob[e];
+          }
+          for (size_t v = 0; v < V; v++)
+            scale[v] += c[v] *= emission_i_t * keep(i, v);
         }
       }
       for (size_t i = 0; i < n_states; i++)
-        cur(i) /= scale(t + 1);
+        for (size_t v = 0; v < V; v++)
+          cur[i * V + v] /= scale[v];
     }
-    prev = cur;
-    cur = zero_vector(n_states);
+    prev.swap(cur);
   }
+}
 
-  for (auto pre : pred[start_state])
-    cur(start_state) += prev(pre) * transition(pre, start_state);
-  scale(T + 1) = cur(start_state);
-  return scale;
+void HMM::log_likelihood_batch(const Data::Seq &s, const matrix_t &keep,
+                               vector_t &logp) const {
+  Workspace &ws = workspace();
+  size_t T = s.size();
+  size_t V = keep.size2();
+  forward_scale_batch(s, keep, ws);
+  logp.resize(V, false);
+  for (size_t v = 0; v < V; v++) {
+    logp(v) = 0;
+    for (size_t t = 0; t < T + 2; t++)
+      logp(v) += log(ws.batch_scale(t, v));
+  }
 }
 
 matrix_t HMM::compute_forward_scaled(const Data::Seq &s,
                                      vector_t &scale) const {
-  size_t T = s.isequence.size();
-  matrix_t m = zero_matrix(T + 2, n_states);
+  size_t T = s.size();
+  matrix_t m(T + 2, n_states);
   if (scale.size() != T + 2)
     scale = zero_vector(T + 2);
+  forward_scaled(s, m, scale);
+  return m;
+}
+
+void HMM::forward_scaled(const Data::Seq &s, matrix_t &m,
+                         vector_t &scale) const {
+  size_t T = s.size();
+  fill_n(&m(0, 0), n_states, 0.0);
 
   m(0, start_state) = 1;
   scale(0) = 1;
-  for (size_t t = 0; t < T; t++) {
-    size_t symbol = s.isequence(t);
-    if (symbol == empty_symbol) {
-      for (auto pre : pred[start_state])
-        m(t + 1, start_state) += m(t, pre) * transition(pre, start_state);
-      scale(t + 1) = m(t + 1, start_state);
-      m(t + 1, start_state) = 1;
-    } else {
-      for (size_t i = 0; i < n_states; i++) {
-        double emission_i_t = emission(i, symbol);
-        if (emission_i_t > 0) {
-          for (auto pre : pred[i])
-            m(t + 1, i) += m(t, pre) * transition(pre, i);
-          scale(t + 1) += m(t + 1, i) *= emission_i_t;
-        }
-      }
-      for (size_t i = 0; i < n_states; i++)
-        m(t + 1, i) /= scale(t + 1);
-    }
+  // the final transition to the start state is like that for an empty symbol
+  for (size_t t = 0; t <= T; t++) {
+    size_t symbol = t < T ? s.symbol(t) : empty_symbol;
+    scale(t + 1) = forward_step(symbol, &m(t, 0), &m(t + 1, 0));
+    scale_forward_step(symbol, scale(t + 1), &m(t + 1, 0));
   }
 
-  for (auto pre : pred[start_state])
-    m(T + 1, start_state) += m(T, pre) * transition(pre, start_state);
-  scale(T + 1) = m(T + 1, start_state);
-  m(T + 1, start_state) = 1;
-
   if (verbosity >= Verbosity::debug)
-    cout << "alpha = " << m << endl;
-  return m;
+    cout << "alpha = "
+         << boost::numeric::ublas::subrange(m, 0, T + 2, 0, n_states) << endl;
 }
 
 matrix_t HMM::compute_forward_prescaled(const Data::Seq &s,
                                         const vector_t &scale) const {
-  size_t T = s.isequence.size();
+  size_t T = s.size();
+  const SparseTransitions &to = trans_to;
   matrix_t m = zero_matrix(T + 2, n_states);
   m(0, start_state) = 1.0 / scale(0);
   for (size_t t = 0; t < T; t++) {
-    size_t symbol = s.isequence(t);
+    size_t symbol = s.symbol(t);
     if (symbol == empty_symbol) {
-      for (auto k : pred[start_state])
-        m(t + 1, start_state) += m(t, k) * transition(k, start_state);
+      for (size_t e = to.offset[start_state]; e < to.offset[start_state + 1];
+           e++)
+        m(t + 1, start_state) += m(t, to.index[e]) * to.prob[e];
       m(t + 1, start_state) /= scale(t + 1);
     } else {
       for (size_t i = 0; i < n_states; i++) {
         double emission_i_t = emission(i, symbol);
         if (emission_i_t > 0) {
-          for (auto k : pred[i])
-            m(t + 1, i) += m(t, k) * transition(k, i);
+          for (size_t e = to.offset[i]; e < to.offset[i + 1]; e++)
+            m(t + 1, i) += m(t, to.index[e]) * to.prob[e];
           m(t + 1, i) *= emission_i_t;
         }
         m(t + 1, i) /= scale(t + 1);
@@ -188,8 +438,8 @@ matrix_t HMM::compute_forward_prescaled(const Data::Seq &s,
     }
   }
 
-  for (auto k : pred[start_state])
-    m(T + 1, start_state) += m(T, k) * transition(k, start_state);
+  for (size_t e = to.offset[start_state]; e < to.offset[start_state + 1]; e++)
+    m(T + 1, start_state) += m(T, to.index[e]) * to.prob[e];
   m(T + 1, start_state) /= scale(T + 1);
   return m;
 }
@@ -197,32 +447,117 @@ matrix_t HMM::compute_forward_prescaled(const Data::Seq &s,
 // Assuming that max_order == 0
 matrix_t HMM::compute_backward_prescaled(const Data::Seq &s,
                                          const vector_t &scale) const {
-  size_t T = s.isequence.size();
-  matrix_t m = zero_matrix(T + 2, n_states);
-  m(T + 1, start_state) = 1 / scale(T + 1);
-  for (size_t i = 0; i < n_states; i++) {
-    for (auto suc : succ[i])
-      m(T, i) += m(T + 1, suc) * transition(i, suc);
-    m(T, i) /= scale(T);
-  }
+  matrix_t m(s.size() + 2, n_states);
+  backward_prescaled(s, scale, m);
+  return m;
+}
 
-  for (int t = T - 1; t >= 0; t--) {
-    size_t symbol = s.isequence(t);
-    if (symbol == empty_symbol)
-      for (auto pre : pred[start_state])
-        m(t, pre) = m(t + 1, start_state) * transition(pre, start_state)
-                    / scale(t);
-    else
-      for (size_t i = 0; i < n_states; i++) {  // TODO flip loops around
-        for (auto suc : succ[i])
-          m(t, i) += m(t + 1, suc) * transition(i, suc) * emission(suc, symbol);
-        m(t, i) /= scale(t);
+void HMM::backward_step(size_t symbol, double scale, const double *next,
+                        double *cur) const {
+  const SparseTransitions &to = trans_to;
+  const SparseTransitions &from = trans_from;
+  fill_n(cur, n_states, 0.0);
+  if (symbol == empty_symbol)
+    for (size_t e = to.offset[start_state]; e < to.offset[start_state + 1];
+         e++)
+      cur[to.index[e]] = next[start_state] * to.prob[e] / scale;
+  else
+    for (size_t i = 0; i < n_states; i++) {  // TODO flip loops around
+      for (size_t e = from.offset[i]; e < from.offset[i + 1]; e++) {
+        size_t suc = from.index[e];
+        cur[i] += next[suc] * from.prob[e] * emission(suc, symbol);
       }
-  }
+      cur[i] /= scale;
+    }
+}
+
+void HMM::forward_step_pair(size_t symbol, const vector<int> &reduce,
+                            const double *prev, const double *prev_r,
+                            double *cur, double *cur_r, double &scale,
+                            double &scale_r) const {
+  const SparseTransitions &to = trans_to;
+  scale = scale_r = 0;
+  fill_n(cur, n_states, 0.0);
+  fill_n(cur_r, n_states, 0.0);
+  if (symbol == empty_symbol) {
+    for (size_t e = to.offset[start_state]; e < to.offset[start_state + 1];
+         e++) {
+      cur[start_state] += prev[to.index[e]] * to.prob[e];
+      cur_r[start_state] += prev_r[to.index[e]] * to.prob[e];
+    }
+    scale = cur[start_state];
+    scale_r = cur_r[start_state];
+  } else
+    for (size_t i = 0; i < n_states; i++) {
+      double emission_i_t = emission(i, symbol);
+      if (emission_i_t > 0) {
+        if (reduce[i] == -1)
+          for (size_t e = to.offset[i]; e < to.offset[i + 1]; e++)
+            cur[i] += prev[to.index[e]] * to.prob[e];
+        else {
+          // predecessors outside of the sub-model contribute zeros
+          for (size_t e = to.offset[i]; e < to.offset[i + 1]; e++) {
+            cur[i] += prev[to.index[e]] * to.prob[e];
+            cur_r[i] += prev_r[to.index[e]] * to.prob[e];
+          }
+          scale_r += cur_r[i] *= emission_i_t;
+        }
+        scale += cur[i] *= emission_i_t;
+      }
+    }
+}
+
+void HMM::backward_step_pair(size_t symbol, const vector<int> &reduce,
+                             double scale, double scale_r, const double *next,
+                             const double *next_r, double *cur,
+                             double *cur_r) const {
+  const SparseTransitions &to = trans_to;
+  const SparseTransitions &from = trans_from;
+  fill_n(cur, n_states, 0.0);
+  fill_n(cur_r, n_states, 0.0);
+  if (symbol == empty_symbol)
+    for (size_t e = to.offset[start_state]; e < to.offset[start_state + 1];
+         e++) {
+      size_t pre = to.index[e];
+      cur[pre] = next[start_state] * to.prob[e] / scale;
+      if (reduce[pre] != -1)
+        cur_r[pre] = next_r[start_state] * to.prob[e] / scale_r;
+    }
+  else
+    for (size_t i = 0; i < n_states; i++) {
+      if (reduce[i] == -1)
+        for (size_t e = from.offset[i]; e < from.offset[i + 1]; e++) {
+          size_t suc = from.index[e];
+          cur[i] += next[suc] * from.prob[e] * emission(suc, symbol);
+        }
+      else {
+        // successors outside of the sub-model contribute zeros
+        for (size_t e = from.offset[i]; e < from.offset[i + 1]; e++) {
+          size_t suc = from.index[e];
+          double emission_suc_t = emission(suc, symbol);
+          cur[i] += next[suc] * from.prob[e] * emission_suc_t;
+          cur_r[i] += next_r[suc] * from.prob[e] * emission_suc_t;
+        }
+        cur_r[i] /= scale_r;
+      }
+      cur[i] /= scale;
+    }
+}
+
+// Assuming that max_order == 0
+void HMM::backward_prescaled(const Data::Seq &s, const vector_t &scale,
+                             matrix_t &m) const {
+  size_t T = s.size();
+  fill_n(&m(T + 1, 0), n_states, 0.0);
+  m(T + 1, start_state) = 1 / scale(T + 1);
+  // the final transition to the start state is like that for an empty symbol
+  backward_step(empty_symbol, scale(T), &m(T + 1, 0), &m(T, 0));
+  for (size_t t = T; t-- > 0;)
+    backward_step(s.symbol(t), scale(t), &m(t + 1, 0), &m(t, 0));
 
   if (verbosity >= Verbosity::debug)
-    cout << "beta = " << m << endl;
-  return m;
+    cout << "beta = "
+         << boost::numeric::ublas::subrange(m, 0, T + 2, 0, n_states) << endl;
 }
 
 double HMM::likelihood_from_scale(const vector_t &scale) const {
@@ -233,17 +568,117 @@ double HMM::likelihood_from_scale(const vector_t &scale) const {
 }
 
 double HMM::log_likelihood_from_scale(const vector_t &scale) const {
+  return log_likelihood_from_scale(scale, scale.size());
+}
+
+double HMM::log_likelihood_from_scale(const vector_t &scale, size_t n) const {
   double logpf = 0;
-  for (size_t i = 0; i < scale.size(); i++)
+  for (size_t i = 0; i < n; i++)
     logpf += log(scale(i));
   return logpf;
 }
 
-double HMM::expected_state_posterior(size_t k, const matrix_t &f,
-                                     const matrix_t &b,
-                                     const vector_t &scale) const {
-  double s = 0;
-  for (size_t i = 0; i < f.size1(); i++)
-    s += f(i, k) * b(i, k) * scale(i);
-  return s;
+void HMM::state_posteriors(
+    const Data::Seq &s, const vector<size_t> &states,
+    const function<void(size_t, const double *)> &visit) const {
+  size_t L = s.size();
+  vector<double> posteriors(states.size());
+  Workspace &ws = workspace();
+  if (not use_checkpointing(2 * (L + 2) * n_states * sizeof(double))) {
+    ws.reserve(L, n_states);
+    forward_scaled(s, ws.alpha, ws.scale);
+    backward_prescaled(s, ws.scale, ws.beta);
+    for (size_t i = 0; i < L + 2; i++) {
+      for (size_t j = 0; j < states.size(); j++)
+        posteriors[j]
+            = ws.alpha(i, states[j]) * ws.beta(i, states[j]) * ws.scale(i);
+      visit(i, posteriors.data());
+    }
+    return;
+  }
+
+  // forward rows 0 to L are grouped into blocks of K rows each, and only the
+  // first row of each block is kept
+  size_t K = checkpoint_block_size(L + 1);
+  size_t n_blocks = L / K + 1;
+
+  if (verbosity >= Verbosity::debug)
+    cout << "Checkpointed posteriors for sequence of length " << L
+         << " with block size " << K << endl;
+
+  ws.reserve(0, n_states);
+  if (ws.scale.size() < L + 2)
+    ws.scale.resize(L + 2, false);
+  Workspace::grow(ws.checkpoints, n_blocks, n_states);
+  Workspace::grow(ws.block, K + 1, n_states);
+  vector_t &scale = ws.scale;
+
+  // forward pass, keeping only the checkpoint rows
+  vector_t &prev = ws.prev;
+  vector_t &cur = ws.cur;
+  fill_n(prev.begin(), n_states, 0.0);
+  prev(start_state) = 1;
+  scale(0) = 1;
+  copy_n(&prev(0), n_states, &ws.checkpoints(0, 0));
+  for (size_t t = 0; t < L; t++) {
+    size_t symbol = s.symbol(t);
+    scale(t + 1) = forward_step(symbol, &prev(0), &cur(0));
+    scale_forward_step(symbol, scale(t + 1), &cur(0));
+    prev.swap(cur);
+    if ((t + 1) % K == 0)
+      copy_n(&prev(0), n_states, &ws.checkpoints((t + 1) / K, 0));
+  }
+  scale(L + 1) = forward_step(empty_symbol, &prev(0), &cur(0));
+  scale_forward_step(empty_symbol, scale(L + 1), &cur(0));
+
+  // the backward row L + 1 is zero except for the start state
+  for (size_t j = 0; j < states.size(); j++)
+    posteriors[j] = states[j] == start_state
+                        ? cur(start_state) * (1 / scale(L + 1)) * scale(L + 1)
+                        : 0;
+  visit(L + 1, posteriors.data());
+
+  // recompute the forward rows of block j
+  size_t loaded = n_blocks;
+  auto load_block = [&](size_t j) {
+    if (j == loaded)
+      return;
+    copy_n(&ws.checkpoints(j, 0), n_states, &ws.block(0, 0));
+    for (size_t t = j * K; t < min((j + 1) * K, L); t++) {
+      size_t symbol = s.symbol(t);
+      size_t r = t - j * K;
+      forward_step(symbol, &ws.block(r, 0), &ws.block(r + 1, 0));
+      scale_forward_step(symbol, scale(t + 1), &ws.block(r + 1, 0));
+    }
+    loaded = j;
+  };
+
+  // backward pass, visiting the positions
+  vector_t &b = ws.prev;
+  vector_t &b_next = ws.cur;
+  fill_n(b_next.begin(), n_states, 0.0);
+  b_next(start_state) = 1 / scale(L + 1);
+  backward_step(empty_symbol, scale(L), &b_next(0), &b(0));
+  for (size_t i = L + 1; i-- > 0;) {
+    // b holds backward row i
+    load_block(i / K);
+    const double *f = &ws.block(i - loaded * K, 0);
+    for (size_t j = 0; j < states.size(); j++)
+      posteriors[j] = f[states[j]] * b(states[j]) * scale(i);
+    visit(i, posteriors.data());
+    if (i > 0) {
+      b.swap(b_next);
+      backward_step(s.symbol(i - 1), scale(i - 1), &b_next(0), &b(0));
+    }
+  }
+}
+
+vector<double> HMM::expected_state_posteriors(
+    const Data::Seq &s, const vector<size_t> &states) const {
+  vector<double> expected(states.size(), 0);
+  state_posteriors(s, states, [&](size_t, const double *posteriors) {
+    for (size_t j = 0; j < states.size(); j++)
+      expected[j] += posteriors[j];
+  });
+  return expected;
 }
@@ -38,67 +38,72 @@ using namespace std;
 
 #define DO_PARALLEL 1
 
-double HMM::log_likelihood_gradient(const Data::Seqs &seqs,
-                                    const Training::Targets &targets,
-                                    matrix_t &transition_g,
-                                    matrix_t &emission_g) const {
-  transition_g = zero_matrix(n_states, n_states);
-  emission_g = zero_matrix(n_states, n_emissions);
-
-  double lp = 0;
-  vector<matrix_t> t_g, e_g;
-
-#pragma omp parallel shared(emission_g, transition_g) if (DO_PARALLEL)
+vector<double> HMM::log_likelihood_gradient(
+    const Schedule::Sets &sets, const Training::Targets &targets,
+    vector<matrix_t> &transition_g, vector<matrix_t> &emission_g) const {
+  const size_t n_sets = sets.size();
+  // thread-local gradients and log-likelihoods of each data set
+  vector<vector<matrix_t>> t_g, e_g;
+  vector<vector<double>> lp;
+
+  const auto tasks = Schedule::by_length(sets);
+  Schedule::Utilization::Loop loop_timer;
+#pragma omp parallel shared(t_g, e_g, lp) if (DO_PARALLEL)
   {
 #pragma omp single
-    // Initalize storage for thread intermediate results
     {
       size_t n_threads = omp_get_num_threads();
-      //    cout << "B Num threads = " << n_threads << endl;
       if (not targets.transition.empty())
-        t_g = vector<matrix_t>(
-            n_threads, zero_matrix(transition_g.size1(), transition_g.size2()));
+        t_g = vector<vector<matrix_t>>(
+            n_threads,
+            vector<matrix_t>(n_sets, zero_matrix(n_states, n_states)));
       if (not targets.emission.empty())
-        e_g = vector<matrix_t>(
-            n_threads, zero_matrix(emission_g.size1(), emission_g.size2()));
+        e_g = vector<vector<matrix_t>>(
+            n_threads,
+            vector<matrix_t>(n_sets, zero_matrix(n_states, n_emissions)));
+      lp = vector<vector<double>>(n_threads, vector<double>(n_sets, 0));
     }
 
-#pragma omp for reduction(+ : lp)
-    // Compute likelihood for each sequence
-    for (size_t i = 0; i < seqs.size(); i++) {
-      int thread_idx = omp_get_thread_num();
-      vector_t scale;
-      matrix_t f = compute_forward_scaled(seqs[i], scale);
-      matrix_t b = compute_backward_prescaled(seqs[i], scale);
+    size_t thread_idx = omp_get_thread_num();
+#pragma omp for schedule(dynamic)
+    for (size_t k = 0; k < tasks.size(); k++) {
+      Schedule::Utilization::Item item_timer;
+      const size_t set_idx = tasks[k].set;
+      const double weight = sets[set_idx]->multiplicity[tasks[k].seq];
+      Workspace &ws = workspace();
 
       // Compute expected statistics
-      matrix_t T, E;
-      double logp = BaumWelchIteration_single(T, E, seqs[i], targets);
-
-      if (not targets.transition.empty())
-        // Compute log likelihood gradients w.r.t. transition probability
-        t_g[thread_idx] += transition_gradient(T, targets.transition);
-
-      if (not targets.emission.empty())
-        // Compute log likelihood gradients w.r.t. emission probability
-        e_g[thread_idx] += emission_gradient(E, targets.emission);
-
-      lp += logp;
+      Workspace::reset(ws.T, n_states, n_states);
+      Workspace::reset(ws.E, n_states, n_emissions);
+      lp[thread_idx][set_idx]
+          += weight * BaumWelchIteration_single(
+                          ws.T, ws.E, sets[set_idx]->sequences[tasks[k].seq],
+                          targets);
+
+      if (not targets.transition.empty()) {
+        transition_gradient(ws.T, targets.transition, ws.t);
+        noalias(t_g[thread_idx][set_idx]) += weight * ws.t;
+      }
+      if (not targets.emission.empty()) {
+        emission_gradient(ws.E, targets.emission, ws.e);
+        noalias(e_g[thread_idx][set_idx]) += weight * ws.e;
+      }
     }
+  }
 
-#pragma omp single
-    // Collect results of threads
-    {
+  // Collect results of threads
+  transition_g = vector<matrix_t>(n_sets, zero_matrix(n_states, n_states));
+  emission_g = vector<matrix_t>(n_sets, zero_matrix(n_states, n_emissions));
+  vector<double> l(n_sets, 0);
+  for (size_t set_idx = 0; set_idx < n_sets; set_idx++)
+    for (size_t thread_idx = 0; thread_idx < lp.size(); thread_idx++) {
       if (not targets.transition.empty())
-        for (auto &x : t_g)
-          transition_g += x;
+        transition_g[set_idx] += t_g[thread_idx][set_idx];
       if (not targets.emission.empty())
-        for (auto &x : e_g)
-          emission_g += x;
+        emission_g[set_idx] += e_g[thread_idx][set_idx];
+      l[set_idx] += lp[thread_idx][set_idx];
     }
-  }
-
-  return lp;
+  return l;
 }
 
 double HMM::chi_square_gradient(const Data::Contrast &contrast,
@@ -114,11 +119,10 @@ double HMM::chi_square_gradient(const Data::Contrast &contrast,
   if (verbosity >= Verbosity::debug)
     cout << "Looking at groups " << present << endl;
 
+  auto posteriors
+      = posterior_gradient(contrast, task, present, trans_g, emission_g);
   for (size_t sample_idx = 0; sample_idx < n_samples; sample_idx++) {
-    counts(sample_idx, 0)
-        = posterior_gradient(contrast.sets[sample_idx], task, present,
-                             trans_g[sample_idx],
-                             emission_g[sample_idx]).posterior;
+    counts(sample_idx, 0) = posteriors[sample_idx].posterior;
     counts(sample_idx, 1) = contrast.sets[sample_idx].set_size
                             - counts(sample_idx, 0);
   }
@@ -219,13 +223,16 @@ double HMM::matthews_correlation_coefficient_gradient(
   double signal_counts = 0, control_counts = 0;
   size_t n_signal = 0, n_control = 0;
 
+  vector<matrix_t> trans_gs, emission_gs;
+  auto posteriors
+      = posterior_gradient(contrast, task, present, trans_gs, emission_gs);
+
   // for each of the samples
   for (size_t set_idx = 0; set_idx < n_samples; set_idx++) {
-    matrix_t trans_g = zero_matrix(n_states, n_states);
-    matrix_t emission_g = zero_matrix(n_states, n_emissions);
+    const matrix_t &trans_g = trans_gs[set_idx];
+    const matrix_t &emission_g = emission_gs[set_idx];
 
-    double counts = posterior_gradient(contrast.sets[set_idx], task, present,
-                                       trans_g, emission_g).posterior;
+    double counts = posteriors[set_idx].posterior;
 
     bool signal = is_present(contrast.sets[set_idx], present);
     size_t total = contrast.sets[set_idx].set_size;
@@ -316,12 +323,14 @@ double HMM::log_likelihood_difference_gradient(const Data::Contrast &contrast,
     g.emission = zero_matrix(n_states, n_emissions);
 
   double log_likelihood_difference = 0;
+  vector<matrix_t> trans_gs, emission_gs;
+  auto log_likels = log_likelihood_gradient(
+      Schedule::data_sets(contrast), task.targets, trans_gs, emission_gs);
   // for each of the samples
   for (size_t set_idx = 0; set_idx < n_samples; set_idx++) {
-    matrix_t trans_g = zero_matrix(n_states, n_states);
-    matrix_t emission_g = zero_matrix(n_states, n_emissions);
-    double log_likel = log_likelihood_gradient(
-        contrast.sets[set_idx].sequences, task.targets, trans_g, emission_g);
+    const matrix_t &trans_g = trans_gs[set_idx];
+    const matrix_t &emission_g = emission_gs[set_idx];
+    double log_likel = log_likels[set_idx];
 
     double sign = is_present(contrast.sets[set_idx], present) ? 1.0 : -1.0;
     log_likelihood_difference += sign * log_likel;
@@ -338,6 +347,10 @@ double HMM::log_likelihood_difference_gradient(const Data::Contrast &contrast,
   return log_likelihood_difference;
 }
 
+/** Compute the probability of correct classification, also known as class
+ * likelihood, or maximum mutual information estimation (MMIE). This routine
+ * actually only computes the transition and emission probability gradient, the
+ * class parameters are re-estimated with another routine. */
 double HMM::class_likelihood_gradient(const Data::Contrast &contrast,
                                       const Training::Task &task,
                                       bitmask_t present, Gradient &g) const {
@@ -349,42 +362,28 @@ double HMM::class_likelihood_gradient(const Data::Contrast &contrast,
   if (not task.targets.emission.empty() and g.emission.size1() == 0)
     g.emission = zero_matrix(n_states, n_emissions);
 
-  double l = 0;
-  for (auto &dataset : contrast)
-    l += class_likelihood_gradient(dataset, task, present, g);
-
-  if (verbosity >= Verbosity::verbose)
-    cout << "Data::Contrast l = " << l << endl;
-
-  return l;
-}
-
-/** Compute the probability of correct classification, also known as class
- * likelihood, or maximum mutual information estimation (MMIE). This routine
- * actually only computes the transition and emission probability gradient, the
- * class parameters are re-estimated with another routine. */
-double HMM::class_likelihood_gradient(const Data::Set &dataset,
-                                      const Training::Task &task,
-                                      bitmask_t present, Gradient &g) const {
-  if (verbosity >= Verbosity::verbose)
-    cout << "HMM::class_likelihood_gradient(Data::Set, Feature)" << endl;
   // TODO check correctness of re-implemented code
   const double marginal_motif_prior
       = registration.compute_marginal_motif_prior(present);
-  const double class_cond
-      = registration.get_class_motif_prior(dataset.sha1, present);
-  const double current_class_prior = registration.get_class_prior(dataset.sha1);
-  const double log_class_prior = log(current_class_prior);
-
-  if (verbosity >= Verbosity::verbose)
-    cout << "marginal_motif_prior = " << marginal_motif_prior << endl
-         << "class_cond = " << class_cond << endl
-         << "current_class_prior = " << current_class_prior << endl
-         << "log_class_prior = " << log_class_prior << endl;
+  const auto sets = Schedule::data_sets(contrast);
+  vector<double> class_conds, class_priors;
+  for (auto dataset : sets) {
+    class_conds.push_back(
+        registration.get_class_motif_prior(dataset->sha1, present));
+    class_priors.push_back(registration.get_class_prior(dataset->sha1));
+    if (verbosity >= Verbosity::verbose)
+      cout << "Data::Set " << dataset->path << endl
+           << "marginal_motif_prior = " << marginal_motif_prior << endl
+           << "class_cond = " << class_conds.back() << endl
+           << "current_class_prior = " << class_priors.back() << endl
+           << "log_class_prior = " << log(class_priors.back()) << endl;
+  }
 
   double l = 0;               // log-likelihood
   vector<matrix_t> t_g, e_g;  // thread-local storage for gradients of
                               // transition and emission probabilities
+  const auto tasks = Schedule::by_length(sets);
+  Schedule::Utilization::Loop loop_timer;
 #pragma omp parallel shared(g, t_g, e_g) if (DO_PARALLEL)
   {
 #pragma omp single
@@ -399,8 +398,15 @@ double HMM::class_likelihood_gradient(const Data::Set &dataset,
             n_threads, zero_matrix(g.emission.size1(), g.emission.size2()));
     }
 
-#pragma omp for schedule(static) reduction(+ : l)
-    for (size_t i = 0; i < dataset.set_size; i++) {
+#pragma omp for schedule(dynamic) reduction(+ : l)
+    for (size_t k = 0; k < tasks.size(); k++) {
+      Schedule::Utilization::Item item_timer;
+      const size_t set_idx = tasks[k].set;
+      const Data::Seq &seq = sets[set_idx]->sequences[tasks[k].seq];
+      const double weight = sets[set_idx]->multiplicity[tasks[k].seq];
+      const double class_cond = class_conds[set_idx];
+      const double current_class_prior = class_priors[set_idx];
+      const double log_class_prior = log(current_class_prior);
       int thread_idx = omp_get_thread_num();
 
       /* c                     Class 1
@@ -415,8 +421,7 @@ double HMM::class_likelihood_gradient(const Data::Set &dataset,
        */
 
       matrix_t t, e;
-      posterior_gradient_t res
-          = posterior_gradient(dataset.sequences[i], task, present, t, e);
+      posterior_gradient_t res = posterior_gradient(seq, task, present, t, e);
       double p = res.posterior;
       double x = 0;
       if (log_class_prior != 0)
@@ -424,7 +429,7 @@ double HMM::class_likelihood_gradient(const Data::Set &dataset,
             + log(p * class_cond / marginal_motif_prior
                   + (1 - p) * (1 - class_cond) / (1 - marginal_motif_prior));
       if (verbosity >= Verbosity::verbose)
-        cout << "Sequence " << dataset.sequences[i].definition << " p = " << p
+        cout << "Sequence " << seq.definition << " p = " << p
              << " class log likelihood = " << x << " exp -> " << exp(x) << endl;
       double term_a = class_cond / marginal_motif_prior - 1;
       double term_b = exp(-x) * current_class_prior
@@ -434,27 +439,28 @@ double HMM::class_likelihood_gradient(const Data::Set &dataset,
       // \del \log P(C|X) = P(C) / (P(C|X) * (1 - P(m))) * (P(m|C)/P(m) - 1) * \del P(m|X)
 
       if (not task.targets.transition.empty())
-        t_g[thread_idx] += term_c * t;
+        t_g[thread_idx] += weight * term_c * t;
       if (not task.targets.emission.empty())
-        e_g[thread_idx] += term_c * e;
+        e_g[thread_idx] += weight * term_c * e;
 
       if (task.measure == Measure::ClassificationLikelihood) {
         if (not task.targets.transition.empty()) {
           // Compute log likelihood gradients for the full model w.r.t.
           // transition probability
           t_g[thread_idx]
-              += transition_gradient(res.T, task.targets.transition);
+              += weight * transition_gradient(res.T, task.targets.transition);
         }
         if (not task.targets.emission.empty()) {
           // Compute log likelihood gradients for the full model w.r.t. emission
           // probability
-          e_g[thread_idx] += emission_gradient(res.E, task.targets.emission);
+          e_g[thread_idx]
+              += weight * emission_gradient(res.E, task.targets.emission);
         }
         x += res.log_likelihood;
       }
       if (not isfinite(x))
         throw Exception::HMM::Calculation::Infinity();
-      l += x;
+      l += weight * x;
     }
 
 #pragma omp single
@@ -467,8 +473,9 @@ double HMM::class_likelihood_gradient(const Data::Set &dataset,
           g.emission += e;
     }
   }
-  if (verbosity >= Verbosity::debug)
-    cout << "Data::Set " << dataset.path << " l = " << l << endl;
+
+  if (verbosity >= Verbosity::verbose)
+    cout << "Data::Contrast l = " << l << endl;
 
   return l;
 }
@@ -490,12 +497,15 @@ double HMM::site_frequency_difference_gradient(const Data::Contrast &contrast,
   double signal_counts = 0, control_counts = 0;
   size_t n_signal = 0, n_control = 0;
 
+  vector<matrix_t> trans_gs, emission_gs;
+  auto posteriors
+      = posterior_gradient(contrast, task, present, trans_gs, emission_gs);
+
   // for each of the samples
   for (size_t set_idx = 0; set_idx < n_samples; set_idx++) {
-    matrix_t trans_g = zero_matrix(n_states, n_states);
-    matrix_t emission_g = zero_matrix(n_states, n_emissions);
-    double counts = posterior_gradient(contrast.sets[set_idx], task, present,
-                                       trans_g, emission_g).posterior;
+    const matrix_t &trans_g = trans_gs[set_idx];
+    const matrix_t &emission_g = emission_gs[set_idx];
+    double counts = posteriors[set_idx].posterior;
     bool signal = is_present(contrast.sets[set_idx], present);
     size_t total = contrast.sets[set_idx].set_size + 2 * pseudo_count;
     total += 2 * pseudo_count;  // Add pseudo-count
@@ -552,18 +562,15 @@ double HMM::mutual_information_gradient(const Data::Contrast &contrast,
   // vectors of transition and emission gradient matrices for each sample
   vector<matrix_t> trans_g(n_samples), emission_g(n_samples);
 
+  // compute posterior gradients for transition and emission probabilities of
+  // all samples
+  auto posteriors
+      = posterior_gradient(contrast, task, present, trans_g, emission_g);
+
   // for each of the samples
   for (size_t sample_idx = 0; sample_idx < n_samples; sample_idx++) {
-    if (verbosity >= Verbosity::debug)
-      cout << "Computing posterior gradient for sample "
-           << contrast.sets[sample_idx].path << endl;
-
-    // compute posterior gradients for transition and emission probabilities,
-    // and store the expected occurrences
-    counts(sample_idx, 0)
-        = posterior_gradient(contrast.sets[sample_idx], task, present,
-                             trans_g[sample_idx],
-                             emission_g[sample_idx]).posterior;
+    // store the expected occurrences
+    counts(sample_idx, 0) = posteriors[sample_idx].posterior;
     counts(sample_idx, 1) = contrast.sets[sample_idx].set_size
                             - counts(sample_idx, 0);
 
@@ -681,15 +688,35 @@ double HMM::rank_information_gradient(const Data::Contrast &contrast,
   if (not task.targets.emission.empty() and g.emission.size1() == 0)
     g.emission = zero_matrix(n_states, n_emissions);
 
+  // compute posterior gradients for transition and emission probabilities,
+  // and the expected occurrences, of all sequences
+  auto results = Schedule::map_sequences<pair<double, Gradient>>(
+      Schedule::data_sets(contrast), [&](size_t, const Data::Seq &seq) {
+        if (verbosity >= Verbosity::debug)
+          cout << "Computing posterior gradient for sequence "
+               << seq.definition << endl;
+        pair<double, Gradient> result;
+        result.first = posterior_gradient(seq, task, present,
+                                          result.second.transition,
+                                          result.second.emission).posterior;
+        if (verbosity >= Verbosity::debug)
+          cout << "Transition gradient of sequence " << seq.definition
+               << " = " << result.second.transition << endl
+               << "Emission gradient of sequence " << seq.definition << " = "
+               << result.second.emission << endl;
+        return result;
+      });
+
   double ri = 0;
-  for (auto &dataset : contrast)
-    ri += rank_information_gradient(dataset, task, present, g);
+  for (size_t set_idx = 0; set_idx < contrast.sets.size(); set_idx++)
+    ri += rank_information_gradient(contrast.sets[set_idx], results[set_idx],
+                                    task, g);
   return ri;
 }
 
-double HMM::rank_information_gradient(const Data::Set &dataset,
-                                      const Training::Task &task,
-                                      bitmask_t present, Gradient &g) const {
+double HMM::rank_information_gradient(
+    const Data::Set &dataset, const vector<pair<double, Gradient>> &results,
+    const Training::Task &task, Gradient &g) const {
   if (verbosity >= Verbosity::debug)
     cout << "HMM::rank_information_gradient(Data::Set, Feature)" << endl;
 
@@ -697,40 +724,8 @@ double HMM::rank_information_gradient(const Data::Set &dataset,
 
   // a vector of expected counts of occurrences across the sequences
   vector_t counts(n);
-  // vectors of transition and emission gradient matrices for each sequence
-  vector<Gradient> gradients(n);
-
-#pragma omp parallel shared(gradients, counts) if (DO_PARALLEL)
-  // for each of the samples
-  for (size_t seq_idx = 0; seq_idx < n; seq_idx++) {
-    if (verbosity >= Verbosity::debug)
-      cout << "Computing posterior gradient for sequence "
-           << dataset.sequences[seq_idx].definition << endl;
-
-    Gradient current_gradient;
-    // compute posterior gradients for transition and emission probabilities,
-    // and store the expected occurrences
-    double current_counts
-        = posterior_gradient(dataset.sequences[seq_idx], task, present,
-                             current_gradient.transition,
-                             current_gradient.emission).posterior;
-
-    if (verbosity >= Verbosity::debug)
-      cout << "Transition gradient of sequence "
-           << dataset.sequences[seq_idx].definition << " = "
-           << gradients[seq_idx].transition << endl
-           << "Emission gradient of sequence "
-           << dataset.sequences[seq_idx].definition << " = "
-           << gradients[seq_idx].emission << endl;
-#pragma omp critical(store_results)
-    {
-      if (not task.targets.transition.empty())
-        gradients[seq_idx].transition = current_gradient.transition;
-      if (not task.targets.emission.empty())
-        gradients[seq_idx].emission = current_gradient.emission;
-      counts(seq_idx) = current_counts;
-    }
-  }
+  for (size_t i = 0; i < n; i++)
+    counts(i) = results[i].first;
 
   if (verbosity >= Verbosity::debug)
     cout << "Posterior = " << counts << endl;
@@ -752,9 +747,9 @@ double HMM::rank_information_gradient(const Data::Set &dataset,
   double cum_count = 0;
   for (size_t i = 0; i < n; i++) {
     if (not task.targets.transition.empty())
-      cumul_gradient.transition += gradients[i].transition;
+      cumul_gradient.transition += results[i].second.transition;
     if (not task.targets.emission.empty())
-      cumul_gradient.emission += gradients[i].emission;
+      cumul_gradient.emission += results[i].second.emission;
 
     if (i < n - 1) {
       cum_count += counts(i);
@@ -815,24 +810,41 @@ double HMM::rank_information_gradient(const Data::Set &dataset,
  * probabilities.*/
 matrix_t HMM::transition_gradient(const matrix_t &T,
                                   const Training::Range &range) const {
-  matrix_t m = zero_matrix(n_states, n_states);
-  for (auto i : range)
-    for (auto j : succ[i])
-      for (auto k : succ[i])
-        m(i, j) += T(i, k) * (((j == k) ? 1 : 0) - transition(i, j));
+  matrix_t m;
+  transition_gradient(T, range, m);
   return m;
 }
 
+void HMM::transition_gradient(const matrix_t &T, const Training::Range &range,
+                              matrix_t &m) const {
+  Workspace::reset(m, n_states, n_states);
+  const SparseTransitions &from = trans_from;
+  for (auto i : range)
+    for (size_t e = from.offset[i]; e < from.offset[i + 1]; e++) {
+      size_t j = from.index[e];
+      for (size_t f = from.offset[i]; f < from.offset[i + 1]; f++) {
+        size_t k = from.index[f];
+        m(i, j) += T(i, k) * (((j == k) ? 1 : 0) - from.prob[e]);
+      }
+    }
+}
+
 /** Compute the log likelihood gradient w.r.t. the transformed emission
  * probabilities.*/
 matrix_t HMM::emission_gradient(const matrix_t &E,
                                 const Training::Range &range) const {
-  matrix_t m = zero_matrix(n_states, n_emissions);
+  matrix_t m;
+  emission_gradient(E, range, m);
+  return m;
+}
+
+void HMM::emission_gradient(const matrix_t &E, const Training::Range &range,
+                            matrix_t &m) const {
+  Workspace::reset(m, n_states, n_emissions);
   for (auto j : range)
     for (size_t k = 0; k < n_emissions; k++)
       for (size_t l = 0; l < n_emissions; l++)
         m(j, k) += E(j, l) * (((k == l) ? 1 : 0) - emission(j, k));
-  return m;
 }
 
 HMM::posterior_gradient_t HMM::posterior_gradient(const Data::Seq &seq,
@@ -844,7 +856,8 @@ HMM::posterior_gradient_t HMM::posterior_gradient(const Data::Seq &seq,
   if (verbosity >= Verbosity::debug)
     cout << "Posterior gradient calculation (Seq, Feature)." << endl;
 
-  SubHMM subhmm(*this, complementary_states_mask(present));
+  auto cached_subhmm = sub_model(present);
+  const SubHMM &subhmm = *cached_subhmm;
 
   if (verbosity >= Verbosity::debug)
     cout << *this << endl << subhmm << endl;
@@ -886,202 +899,143 @@ HMM::posterior_gradient_t HMM::posterior_gradient(const Data::Seq &seq,
     cout << endl;
   }
 
-  // Compute gradient for each sequence
-  // int thread_idx = omp_get_thread_num();
-  // if(verbosity >= Verbosity::debug)
-  //   cout << "Thread " << thread_idx << " Data sample " <<  endl
-  //        << seq2string(seq.sequence) << endl;
+  posterior_t res = posterior_gradient(seq, subhmm, task.targets,
+                                       reduced_targets, transition_g,
+                                       emission_g);
 
-  // Compute expected statistics, for the full and reduced models
-  matrix_t T, Tr, E, Er;
-  double logp = BaumWelchIteration_single(T, E, seq, task.targets);
-  double logpr = subhmm.BaumWelchIteration_single(Tr, Er, seq, reduced_targets);
+  if (verbosity >= Verbosity::verbose)
+    cout << "The posterior coming from the gradient calculus: "
+         << res.posterior << endl;
+  const Workspace &ws = workspace();
+  posterior_gradient_t result = {res.log_likelihood, res.posterior, ws.T, ws.E};
+  return result;
+}
 
-  Tr = subhmm.lift_transition(Tr);
-  Er = subhmm.lift_emission(Er);
+HMM::posterior_t HMM::posterior_gradient(
+    const Data::Seq &seq, const SubHMM &subhmm,
+    const Training::Targets &targets, const Training::Targets &reduced_targets,
+    matrix_t &transition_g, matrix_t &emission_g, double weight) const {
+  Workspace &ws = workspace();
+
+  // Compute expected statistics, for the full and reduced models
+  Workspace::reset(ws.T, n_states, n_states);
+  Workspace::reset(ws.E, n_states, n_emissions);
+  double logp, logpr;
+  size_t L = seq.size();
+  if (not use_checkpointing(4 * (L + 2) * n_states * sizeof(double))) {
+    // a single sweep yields the reduced model's counts already lifted
+    Workspace::reset(ws.T_lifted, n_states, n_states);
+    Workspace::reset(ws.E_lifted, n_states, n_emissions);
+    logp = BaumWelchIteration_pair(ws.T, ws.E, ws.T_lifted, ws.E_lifted, logpr,
+                                   seq, subhmm, targets);
+  } else {
+    Workspace::reset(ws.Tr, subhmm.n_states, subhmm.n_states);
+    Workspace::reset(ws.Er, subhmm.n_states, n_emissions);
+    logp = BaumWelchIteration_single(ws.T, ws.E, seq, targets);
+    logpr = subhmm.BaumWelchIteration_single(ws.Tr, ws.Er, seq,
+                                             reduced_targets);
+    subhmm.lift_transition(ws.Tr, ws.T_lifted);
+    subhmm.lift_emission(ws.Er, ws.E_lifted);
+  }
 
   if (verbosity >= Verbosity::debug)
     cout << "Full logp = " << logp << endl << "Reduced logp = " << logpr << endl
-         << "Expected transitions full = " << T << endl
-         << "Expected emissions full = " << E << endl
-         << "Expected transitions constitutive_range = " << Tr << endl
-         << "Expected emissions constitutive_range = " << Er << endl;
+         << "Expected transitions full = " << ws.T << endl
+         << "Expected emissions full = " << ws.E << endl
+         << "Expected transitions constitutive_range = " << ws.T_lifted << endl
+         << "Expected emissions constitutive_range = " << ws.E_lifted << endl;
 
-  if (not task.targets.transition.empty()) {
+  if (not targets.transition.empty()) {
     // Compute log likelihood gradients for the full model w.r.t. transition
     // probability
-    matrix_t t = transition_gradient(T, task.targets.transition);
+    transition_gradient(ws.T, targets.transition, ws.t);
     // Compute log likelihood gradients for the reduced model w.r.t. transition
     // probability
-    matrix_t tr = transition_gradient(Tr, task.targets.transition);
+    transition_gradient(ws.T_lifted, targets.transition, ws.tr);
 
     // Compute posterior probability gradients for the reduced model w.r.t.
     // transition probability and accumulate
-    transition_g += exp(logpr - logp) * (t - tr);
+    noalias(transition_g) += weight * exp(logpr - logp) * (ws.t - ws.tr);
   }
 
-  if (not task.targets.emission.empty()) {
+  if (not targets.emission.empty()) {
     // Compute log likelihood gradients for the full model w.r.t. emission
     // probability
-    matrix_t e = emission_gradient(E, task.targets.emission);
+    emission_gradient(ws.E, targets.emission, ws.e);
     // Compute log likelihood gradients for the reduced model w.r.t. emission
     // probability
-    matrix_t er = emission_gradient(Er, task.targets.emission);
+    emission_gradient(ws.E_lifted, targets.emission, ws.er);
 
     // Compute posterior probability gradients for the reduced model w.r.t.
     // emission probability and accumulate
-    emission_g += exp(logpr - logp) * (e - er);
+    noalias(emission_g) += weight * exp(logpr - logp) * (ws.e - ws.er);
   }
 
-  double posterior = 1 - exp(logpr - logp);
-
-  if (verbosity >= Verbosity::verbose)
-    cout << "The posterior coming from the gradient calculus: " << posterior
-         << endl;
-  posterior_gradient_t result = {logp, posterior, T, E};
+  posterior_t result = {logp, 1 - exp(logpr - logp)};
   return result;
 }
 
-HMM::posterior_t HMM::posterior_gradient(const Data::Set &dataset,
-                                         const Training::Task &task,
-                                         bitmask_t present,
-                                         matrix_t &transition_g,
-                                         matrix_t &emission_g) const {
-  // Training::Task task(task_);
+vector<HMM::posterior_t> HMM::posterior_gradient(
+    const Data::Contrast &contrast, const Training::Task &task,
+    bitmask_t present, vector<matrix_t> &transition_g,
+    vector<matrix_t> &emission_g) const {
   if (verbosity >= Verbosity::verbose)
-    cout << "Posterior gradient calculation (Feature)." << endl;
-
-  SubHMM subhmm(*this, complementary_states_mask(present));
-
-  // cout << subhmm << endl;
-
-  if (verbosity >= Verbosity::debug) {
-    cout << "Transition targets are";
-    for (auto x : task.targets.transition)
-      cout << " " << x;
-    cout << endl;
-    cout << "Emission targets are";
-    for (auto x : task.targets.emission)
-      cout << " " << x;
-    cout << endl;
-  }
-
-  if (not task.targets.transition.empty())
-    transition_g = zero_matrix(n_states, n_states);
-  if (not task.targets.emission.empty())
-    emission_g = zero_matrix(n_states, n_emissions);
-  double posterior = 0;
-  vector<matrix_t> t_g, e_g;
+    cout << "Posterior gradient calculation (Data::Contrast)." << endl;
 
+  auto cached_subhmm = sub_model(present);
+  const SubHMM &subhmm = *cached_subhmm;
   Training::Targets reduced_targets = subhmm.map_down(task.targets);
 
-  if (verbosity >= Verbosity::debug) {
-    cout << "targets emission = ";
-    for (auto &x : task.targets.emission)
-      cout << " " << x;
-    cout << endl;
-    cout << "targets transition = ";
-    for (auto &x : task.targets.transition)
-      cout << " " << x;
-    cout << endl;
-    cout << "reduced targets emission = ";
-    for (auto &x : reduced_targets.emission)
-      cout << " " << x;
-    cout << endl;
-    cout << "reduced targets transition = ";
-    for (auto &x : reduced_targets.transition)
-      cout << " " << x;
-    cout << endl;
-  }
-
-  double l = 0;
+  const auto sets = Schedule::data_sets(contrast);
+  const size_t n_sets = sets.size();
+  // thread-local gradients and posteriors of each data set
+  vector<vector<matrix_t>> t_g, e_g;
+  vector<vector<posterior_t>> res;
 
-#pragma omp parallel shared(emission_g, transition_g) if (DO_PARALLEL)
+  const auto tasks = Schedule::by_length(sets);
+  Schedule::Utilization::Loop loop_timer;
+#pragma omp parallel shared(t_g, e_g, res) if (DO_PARALLEL)
   {
 #pragma omp single
-    // Initalize storage for thread intermediate results
     {
       size_t n_threads = omp_get_num_threads();
-      //    cout << "B Num threads = " << n_threads << endl;
-      if (not task.targets.transition.empty())
-        t_g = vector<matrix_t>(
-            n_threads, zero_matrix(transition_g.size1(), transition_g.size2()));
-      if (not task.targets.emission.empty())
-        e_g = vector<matrix_t>(
-            n_threads, zero_matrix(emission_g.size1(), emission_g.size2()));
+      t_g = vector<vector<matrix_t>>(
+          n_threads, vector<matrix_t>(n_sets, zero_matrix(n_states, n_states)));
+      e_g = vector<vector<matrix_t>>(
+          n_threads,
+          vector<matrix_t>(n_sets, zero_matrix(n_states, n_emissions)));
+      res = vector<vector<posterior_t>>(n_threads,
+                                        vector<posterior_t>(n_sets, {0, 0}));
     }
 
-#pragma omp for reduction(+ : posterior, l)
-    // Compute gradient for each sequence
-    for (size_t i = 0; i < dataset.sequences.size(); i++) {
-      int thread_idx = omp_get_thread_num();
-      if (verbosity >= Verbosity::debug)
-        cout << "Thread " << thread_idx << " Data sample " << i << endl
-             << seq2string(dataset.sequences[i].isequence) << endl;
-
-      // Compute expected statistics, for the full and reduced models
-      matrix_t T, Tr, E, Er;
-      double logp
-          = BaumWelchIteration_single(T, E, dataset.sequences[i], task.targets);
-      double logpr = subhmm.BaumWelchIteration_single(
-          Tr, Er, dataset.sequences[i], reduced_targets);
-
-      Tr = subhmm.lift_transition(Tr);
-      Er = subhmm.lift_emission(Er);
-
-      if (verbosity >= Verbosity::debug)
-        cout << "Full logp = " << logp << endl << "Reduced logp = " << logpr
-             << endl << "Expected transitions full = " << T << endl
-             << "Expected emissions full = " << E << endl
-             << "Expected transitions constitutive_range = " << Tr << endl
-             << "Expected emissions constitutive_range = " << Er << endl;
-
-      if (not task.targets.transition.empty()) {
-        // Compute log likelihood gradients for the full model w.r.t. transition
-        // probability
-        matrix_t t = transition_gradient(T, task.targets.transition);
-        // Compute log likelihood gradients for the reduced model w.r.t.
-        // transition probability
-        matrix_t tr = transition_gradient(Tr, task.targets.transition);
-
-        // Compute posterior probability gradients for the reduced model w.r.t.
-        // transition probability and accumulate
-        t_g[thread_idx] += exp(logpr - logp) * (t - tr);
-      }
-
-      if (not task.targets.emission.empty()) {
-        // Compute log likelihood gradients for the full model w.r.t. emission
-        // probability
-        matrix_t e = emission_gradient(E, task.targets.emission);
-        // Compute log likelihood gradients for the reduced model w.r.t.
-        // emission probability
-        matrix_t er = emission_gradient(Er, task.targets.emission);
-
-        // Compute posterior probability gradients for the reduced model w.r.t.
-        // emission probability and accumulate
-        e_g[thread_idx] += exp(logpr - logp) * (e - er);
-      }
-
-      posterior += 1 - exp(logpr - logp);
-      l += logp;
+    size_t thread_idx = omp_get_thread_num();
+#pragma omp for schedule(dynamic)
+    for (size_t k = 0; k < tasks.size(); k++) {
+      Schedule::Utilization::Item item_timer;
+      const size_t set_idx = tasks[k].set;
+      const double weight = sets[set_idx]->multiplicity[tasks[k].seq];
+      posterior_t r = posterior_gradient(
+          sets[set_idx]->sequences[tasks[k].seq], subhmm, task.targets,
+          reduced_targets, t_g[thread_idx][set_idx], e_g[thread_idx][set_idx],
+          weight);
+      res[thread_idx][set_idx].log_likelihood += weight * r.log_likelihood;
+      res[thread_idx][set_idx].posterior += weight * r.posterior;
     }
+  }
 
-#pragma omp single
-    // Collect results of threads
-    {
+  // Collect results of threads
+  transition_g = vector<matrix_t>(n_sets, zero_matrix(n_states, n_states));
+  emission_g = vector<matrix_t>(n_sets, zero_matrix(n_states, n_emissions));
+  vector<posterior_t> result(n_sets, {0, 0});
+  for (size_t set_idx = 0; set_idx < n_sets; set_idx++)
+    for (size_t thread_idx = 0; thread_idx < res.size(); thread_idx++) {
       if (not task.targets.transition.empty())
-        for (auto &x : t_g)
-          transition_g += x;
+        transition_g[set_idx] += t_g[thread_idx][set_idx];
       if (not task.targets.emission.empty())
-        for (auto &x : e_g)
-          emission_g += x;
+        emission_g[set_idx] += e_g[thread_idx][set_idx];
+      result[set_idx].log_likelihood += res[thread_idx][set_idx].log_likelihood;
+      result[set_idx].posterior += res[thread_idx][set_idx].posterior;
     }
-  }
-
-  if (verbosity >= Verbosity::verbose)
-    cout << "The posterior coming from the gradient calculus: " << posterior
-         << endl;
-  posterior_t result = {l, posterior};
   return result;
 }
 
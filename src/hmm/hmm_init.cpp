@@ -33,6 +33,7 @@ using namespace std;
 
 void HMM::finalize_initialization() {
   initialize_pred_succ();
+  compile_emissions();
   check_consistency();
 }
 
@@ -49,8 +50,43 @@ void HMM::initialize_pred_succ() {
         pred[j].push_back(i);
         succ[i].push_back(j);
       }
+  compile_transitions();
 };
 
+void HMM::compile_transitions() {
+  sub_models.clear();
+  // rows of trans_to are destinations, those of trans_from are sources
+  auto compile = [&](SparseTransitions &sparse,
+                     const vector<vector<size_t>> &adjacency, bool by_source) {
+    sparse.offset.resize(n_states + 1);
+    sparse.index.clear();
+    sparse.prob.clear();
+    sparse.log_prob.clear();
+    sparse.max_degree = 0;
+    for (size_t i = 0; i < n_states; i++) {
+      sparse.offset[i] = sparse.index.size();
+      for (auto j : adjacency[i]) {
+        double p = by_source ? transition(i, j) : transition(j, i);
+        sparse.index.push_back(j);
+        sparse.prob.push_back(p);
+        sparse.log_prob.push_back(log(p));
+      }
+      sparse.max_degree = max(sparse.max_degree, adjacency[i].size());
+    }
+    sparse.offset[n_states] = sparse.index.size();
+  };
+  compile(trans_to, pred, false);
+  compile(trans_from, succ, true);
+}
+
+void HMM::compile_emissions() {
+  sub_models.clear();
+  log_emission = matrix_t(emission.size1(), emission.size2());
+  for (size_t i = 0; i < emission.size1(); i++)
+    for (size_t j = 0; j < emission.size2(); j++)
+      log_emission(i, j) = log(emission(i, j));
+}
+
 /** Initialize the emission matrix */
 void HMM::initialize_emissions() {
   // Start state does not emit
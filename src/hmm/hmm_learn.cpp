@@ -27,11 +27,13 @@
  * =====================================================================================
  */
 
+#include <omp.h>
 #include <fstream>
 #include <iomanip>
 #include "../timer.hpp"
 #include "../aux.hpp"
 #include "hmm.hpp"
+#include "subhmm.hpp"
 #include "../format_constants.hpp"
 
 using namespace std;
@@ -72,6 +74,7 @@ string line_search_status(int status) {
 void HMM::train_background(const Data::Collection &collection,
                            const Options::HMM &options) {
   HMM bg_hmm(options.verbosity);
+  bg_hmm.set_checkpoint_memory(options.checkpoint_memory);
 
   Training::Task task;
   task.measure = Measure::Likelihood;
@@ -90,9 +93,11 @@ void HMM::train_background(const Data::Collection &collection,
   for (size_t i = 0; i < bg_hmm.transition.size1(); i++)
     for (size_t j = 0; j < bg_hmm.transition.size2(); j++)
       transition(i, j) = bg_hmm.transition(i, j);
+  compile_transitions();
   for (size_t i = 0; i < bg_hmm.emission.size1(); i++)
     for (size_t j = 0; j < bg_hmm.emission.size2(); j++)
       emission(i, j) = bg_hmm.emission(i, j);
+  compile_emissions();
 
   if (transition.size1() > bg_hmm.transition.size1())
     throw Exception::HMM::Learning::TrainBgTooLate();
@@ -222,42 +227,123 @@ double HMM::BaumWelchIteration(matrix_t &T, matrix_t &E,
                                const Data::Collection &collection,
                                const Training::Targets &targets,
                                const Options::HMM &options) const {
-  double log_likel = 0;
-  for (auto &contrast : collection)
-    for (auto &dataset : contrast)
-      if (not dataset.is_control)
-        log_likel += BaumWelchIteration(T, E, dataset, targets, options);
+  Schedule::Sets sets;
+  for (auto dataset : Schedule::data_sets(collection))
+    if (not dataset->is_control)
+      sets.push_back(dataset);
+  double log_likel = BaumWelchIteration(T, E, sets, targets);
   if (verbosity >= Verbosity::debug)
     cout << "Done BaumWelchIteration(Collection) log_likel = " << log_likel
          << endl;
   return log_likel;
 }
 
+/** Sum the thread-local matrices into the first one by a pairwise tree
+ * reduction; to be called by all threads of the enclosing parallel region,
+ * with one matrix per thread. */
+static void tree_reduce(vector<matrix_t> &parts) {
+  size_t n = parts.size();
+  size_t idx = omp_get_thread_num();
+  for (size_t stride = 1; stride < n; stride *= 2) {
+#pragma omp barrier
+    if (idx % (2 * stride) == 0 and idx + stride < n)
+      noalias(parts[idx]) += parts[idx + stride];
+  }
+#pragma omp barrier
+}
+
 double HMM::BaumWelchIteration(matrix_t &T, matrix_t &E,
                                const Data::Set &dataset,
                                const Training::Targets &targets,
                                const Options::HMM &options) const {
+  return BaumWelchIteration(T, E, Schedule::Sets{&dataset}, targets);
+}
+
+double HMM::BaumWelchIteration(matrix_t &T, matrix_t &E,
+                               const Schedule::Sets &sets,
+                               const Training::Targets &targets) const {
   double log_likel = 0;
-  // TODO find out if there's a performance benefit to the split-up critical
-  // regions.
-#pragma omp parallel for reduction(+ : log_likel) shared(E, T) if (DO_PARALLEL)
-  for (size_t j = 0; j < dataset.sequences.size(); j++)
-    log_likel += BaumWelchIteration(T, E, dataset.sequences[j], targets);
+  vector<matrix_t> t, e;  // thread-local expected counts
+
+  const auto tasks = Schedule::by_length(sets);
+  Schedule::Utilization::Loop loop_timer;
+#pragma omp parallel shared(E, T, t, e) if (DO_PARALLEL)
+  {
+#pragma omp single
+    {
+      size_t n_threads = omp_get_num_threads();
+      if (not targets.transition.empty())
+        t = vector<matrix_t>(n_threads, zero_matrix(n_states, n_states));
+      if (not targets.emission.empty())
+        e = vector<matrix_t>(n_threads, zero_matrix(n_states, n_emissions));
+    }
+
+    size_t thread_idx = omp_get_thread_num();
+    matrix_t dummy;
+    matrix_t &t_thread = targets.transition.empty() ? dummy : t[thread_idx];
+    matrix_t &e_thread = targets.emission.empty() ? dummy : e[thread_idx];
+
+    // the counts of each sequence are accumulated directly into the
+    // thread's matrices, touching only the entries of existing transitions;
+    // those of repeated sequences are weighted by way of the workspace
+#pragma omp for schedule(dynamic) reduction(+ : log_likel)
+    for (size_t k = 0; k < tasks.size(); k++) {
+      Schedule::Utilization::Item item_timer;
+      const Data::Seq &seq = sets[tasks[k].set]->sequences[tasks[k].seq];
+      const size_t weight = sets[tasks[k].set]->multiplicity[tasks[k].seq];
+      if (weight == 1)
+        log_likel
+            += BaumWelchIteration_single(t_thread, e_thread, seq, targets);
+      else {
+        Workspace &ws = workspace();
+        Workspace::reset(ws.T, n_states, n_states);
+        Workspace::reset(ws.E, n_states, n_emissions);
+        log_likel += weight * BaumWelchIteration_single(ws.T, ws.E, seq,
+                                                        targets);
+        if (not targets.transition.empty())
+          noalias(t_thread) += weight * ws.T;
+        if (not targets.emission.empty())
+          noalias(e_thread) += weight * ws.E;
+      }
+    }
+
+    if (not targets.transition.empty())
+      tree_reduce(t);
+    if (not targets.emission.empty())
+      tree_reduce(e);
+
+#pragma omp single
+    {
+      if (not targets.transition.empty())
+        noalias(T) += t[0];
+      if (not targets.emission.empty())
+        noalias(E) += e[0];
+    }
+  }
+
   if (verbosity >= Verbosity::debug)
-    cout << "Done BaumWelchIteration(Seqs) log_likel = " << log_likel << endl;
+    cout << "Done BaumWelchIteration(Sets) log_likel = " << log_likel << endl;
   return log_likel;
 }
 
 double HMM::BaumWelchIteration_single(matrix_t &T, matrix_t &E,
                                       const Data::Seq &s,
                                       const Training::Targets &targets) const {
-  size_t L = s.isequence.size();
-
-  vector_t scale;
-  matrix_t f = compute_forward_scaled(s, scale);
-  matrix_t b = compute_backward_prescaled(s, scale);
-
-  double log_likel = log_likelihood_from_scale(scale);
+  size_t L = s.size();
+  if (use_checkpointing(2 * (L + 2) * n_states * sizeof(double)))
+    return BaumWelchIteration_checkpointed(T, E, s, targets);
+
+  Workspace &ws = workspace();
+  ws.reserve(L, n_states);
+  forward_scaled(s, ws.alpha, ws.scale);
+  backward_prescaled(s, ws.scale, ws.beta);
+  const matrix_t &f = ws.alpha;
+  const matrix_t &b = ws.beta;
+  const vector_t &scale = ws.scale;
+  const SparseTransitions &to = trans_to;
+  const SparseTransitions &from = trans_from;
+
+  double log_likel = log_likelihood_from_scale(scale, L + 2);
 
   if (not targets.transition.empty()) {
     if (not(T.size1() == n_states and T.size2() == n_states))
@@ -265,7 +351,7 @@ double HMM::BaumWelchIteration_single(matrix_t &T, matrix_t &E,
 
     // for all transitions except the one to the start state
     for (size_t i = 0; i < L; i++) {
-      size_t symbol = s.isequence(i);
+      size_t symbol = s.symbol(i);
       if (symbol == empty_symbol)
         for (auto k : targets.transition)
           T(k, start_state) += f(i, k) * transition(k, start_state)
@@ -274,16 +360,19 @@ double HMM::BaumWelchIteration_single(matrix_t &T, matrix_t &E,
         // TODO change the order of the loops
         for (auto k : targets.transition) {
           double f_i_k = f(i, k);
-          for (auto suc : succ[k])
-            T(k, suc) += f_i_k * transition(k, suc) * emission(suc, symbol)
+          for (size_t e = from.offset[k]; e < from.offset[k + 1]; e++) {
+            size_t suc = from.index[e];
+            T(k, suc) += f_i_k * from.prob[e] * emission(suc, symbol)
                          * b(i + 1, suc);
+          }
         }
     }
 
     // for the transition to the start_state
-    for (auto pre : pred[start_state])
-      T(pre, start_state) += f(L, pre) * transition(pre, start_state)
-                             * b(L + 1, start_state);
+    for (size_t e = to.offset[start_state]; e < to.offset[start_state + 1];
+         e++)
+      T(to.index[e], start_state) += f(L, to.index[e]) * to.prob[e]
+                                      * b(L + 1, start_state);
   }
 
   if (not targets.emission.empty()) {
@@ -291,7 +380,7 @@ double HMM::BaumWelchIteration_single(matrix_t &T, matrix_t &E,
       E = zero_matrix(n_states, n_emissions);
 
     for (size_t i = 0; i < L; i++) {
-      size_t symbol = s.isequence(i);
+      size_t symbol = s.symbol(i);
       if (symbol != empty_symbol)
         for (auto k : targets.emission)
           E(k, symbol) += f(i + 1, k) * b(i + 1, k) * scale(i + 1);
@@ -300,68 +389,231 @@ double HMM::BaumWelchIteration_single(matrix_t &T, matrix_t &E,
   return log_likel;
 }
 
-double HMM::BaumWelchIteration(matrix_t &T, matrix_t &E, const Data::Seq &s,
-                               const Training::Targets &targets) const {
-  size_t L = s.isequence.size();
-
-  vector_t scale;
-  matrix_t f = compute_forward_scaled(s, scale);
-  matrix_t b = compute_backward_prescaled(s, scale);
+double HMM::BaumWelchIteration_checkpointed(
+    matrix_t &T, matrix_t &E, const Data::Seq &s,
+    const Training::Targets &targets) const {
+  size_t L = s.size();
+  // forward rows 0 to L are grouped into blocks of K rows each, and only the
+  // first row of each block is kept
+  size_t K = checkpoint_block_size(L + 1);
+  size_t n_blocks = L / K + 1;
 
-  double log_likel = log_likelihood_from_scale(scale);
   if (verbosity >= Verbosity::debug)
-    cerr << "log_likel = " << log_likel << endl;
+    cout << "Checkpointed Baum-Welch for sequence of length " << L
+         << " with block size " << K << endl;
+
+  Workspace &ws = workspace();
+  ws.reserve(0, n_states);
+  if (ws.scale.size() < L + 2)
+    ws.scale.resize(L + 2, false);
+  Workspace::grow(ws.checkpoints, n_blocks, n_states);
+  Workspace::grow(ws.block, K + 1, n_states);
+  vector_t &scale = ws.scale;
+  const SparseTransitions &to = trans_to;
+  const SparseTransitions &from = trans_from;
+
+  // forward pass, keeping only the checkpoint rows
+  vector_t &prev = ws.prev;
+  vector_t &cur = ws.cur;
+  fill_n(prev.begin(), n_states, 0.0);
+  prev(start_state) = 1;
+  scale(0) = 1;
+  copy_n(&prev(0), n_states, &ws.checkpoints(0, 0));
+  for (size_t t = 0; t < L; t++) {
+    size_t symbol = s.symbol(t);
+    scale(t + 1) = forward_step(symbol, &prev(0), &cur(0));
+    scale_forward_step(symbol, scale(t + 1), &cur(0));
+    prev.swap(cur);
+    if ((t + 1) % K == 0)
+      copy_n(&prev(0), n_states, &ws.checkpoints((t + 1) / K, 0));
+  }
+  scale(L + 1) = forward_step(empty_symbol, &prev(0), &cur(0));
+
+  double log_likel = log_likelihood_from_scale(scale, L + 2);
+
+  // recompute the forward rows of block j, and the first row of block j + 1
+  size_t loaded = n_blocks;
+  auto load_block = [&](size_t j) {
+    if (j == loaded)
+      return;
+    copy_n(&ws.checkpoints(j, 0), n_states, &ws.block(0, 0));
+    for (size_t t = j * K; t < min((j + 1) * K, L); t++) {
+      size_t symbol = s.symbol(t);
+      size_t r = t - j * K;
+      forward_step(symbol, &ws.block(r, 0), &ws.block(r + 1, 0));
+      scale_forward_step(symbol, scale(t + 1), &ws.block(r + 1, 0));
+    }
+    loaded = j;
+  };
+
+  if (not targets.transition.empty())
+    if (not(T.size1() == n_states and T.size2() == n_states))
+      T = zero_matrix(n_states, n_states);
+  if (not targets.emission.empty())
+    if (not(E.size1() == n_states and E.size2() == n_emissions))
+      E = zero_matrix(n_states, n_emissions);
+
+  // backward pass, accumulating the expected counts
+  vector_t &b = ws.prev;
+  vector_t &b_prev = ws.cur;
+  fill_n(b.begin(), n_states, 0.0);
+  b(start_state) = 1 / scale(L + 1);
+  backward_step(empty_symbol, scale(L), &b(0), &b_prev(0));
+
+  // for the transition to the start_state
+  load_block(L / K);
+  if (not targets.transition.empty()) {
+    const double *f = &ws.block(L - loaded * K, 0);
+    for (size_t e = to.offset[start_state]; e < to.offset[start_state + 1];
+         e++)
+      T(to.index[e], start_state) += f[to.index[e]] * to.prob[e]
+                                      * b(start_state);
+  }
+  b.swap(b_prev);
+
+  for (size_t i = L; i-- > 0;) {
+    // b holds backward row i + 1
+    load_block(i / K);
+    const double *f = &ws.block(i - loaded * K, 0);
+    const double *f_next = &ws.block(i + 1 - loaded * K, 0);
+    size_t symbol = s.symbol(i);
+
+    if (not targets.transition.empty()) {
+      if (symbol == empty_symbol)
+        for (auto k : targets.transition)
+          T(k, start_state) += f[k] * transition(k, start_state)
+                               * b(start_state);
+      else
+        for (auto k : targets.transition)
+          for (size_t e = from.offset[k]; e < from.offset[k + 1]; e++) {
+            size_t suc = from.index[e];
+            T(k, suc) += f[k] * from.prob[e] * emission(suc, symbol) * b(suc);
+          }
+    }
+
+    if (not targets.emission.empty() and symbol != empty_symbol)
+      for (auto k : targets.emission)
+        E(k, symbol) += f_next[k] * b(k) * scale(i + 1);
+
+    if (i > 0) {
+      backward_step(symbol, scale(i), &b(0), &b_prev(0));
+      b.swap(b_prev);
+    }
+  }
+  return log_likel;
+}
+
+double HMM::BaumWelchIteration_pair(matrix_t &T, matrix_t &E, matrix_t &T_r,
+                                    matrix_t &E_r, double &log_likel_r,
+                                    const Data::Seq &s, const SubHMM &subhmm,
+                                    const Training::Targets &targets) const {
+  size_t L = s.size();
+  const vector<int> &reduce = subhmm.reduce;
+
+  Workspace &ws = workspace();
+  ws.reserve(L, n_states);
+  Workspace::grow(ws.alpha_r, L + 2, n_states);
+  Workspace::grow(ws.beta_r, L + 2, n_states);
+  if (ws.scale_r.size() < L + 2)
+    ws.scale_r.resize(L + 2, false);
+  matrix_t &f = ws.alpha, &f_r = ws.alpha_r;
+  matrix_t &b = ws.beta, &b_r = ws.beta_r;
+  vector_t &scale = ws.scale, &scale_r = ws.scale_r;
+  const SparseTransitions &to = trans_to;
+  const SparseTransitions &from = trans_from;
+
+  // forward pass; the final transition to the start state is like that for
+  // an empty symbol
+  fill_n(&f(0, 0), n_states, 0.0);
+  fill_n(&f_r(0, 0), n_states, 0.0);
+  f(0, start_state) = f_r(0, start_state) = 1;
+  scale(0) = scale_r(0) = 1;
+  for (size_t t = 0; t <= L; t++) {
+    size_t symbol = t < L ? s.symbol(t) : empty_symbol;
+    forward_step_pair(symbol, reduce, &f(t, 0), &f_r(t, 0), &f(t + 1, 0),
+                      &f_r(t + 1, 0), scale(t + 1), scale_r(t + 1));
+    scale_forward_step(symbol, scale(t + 1), &f(t + 1, 0));
+    scale_forward_step(symbol, scale_r(t + 1), &f_r(t + 1, 0));
+  }
+
+  // backward pass
+  fill_n(&b(L + 1, 0), n_states, 0.0);
+  fill_n(&b_r(L + 1, 0), n_states, 0.0);
+  b(L + 1, start_state) = 1 / scale(L + 1);
+  b_r(L + 1, start_state) = 1 / scale_r(L + 1);
+  for (size_t t = L + 1; t-- > 0;) {
+    size_t symbol = t < L ? s.symbol(t) : empty_symbol;
+    backward_step_pair(symbol, reduce, scale(t), scale_r(t), &b(t + 1, 0),
+                       &b_r(t + 1, 0), &b(t, 0), &b_r(t, 0));
+  }
+
+  double log_likel = log_likelihood_from_scale(scale, L + 2);
+  log_likel_r = log_likelihood_from_scale(scale_r, L + 2);
 
   if (not targets.transition.empty()) {
-    matrix_t t = zero_matrix(n_states, n_states);
+    if (not(T.size1() == n_states and T.size2() == n_states))
+      T = zero_matrix(n_states, n_states);
+    if (not(T_r.size1() == n_states and T_r.size2() == n_states))
+      T_r = zero_matrix(n_states, n_states);
 
     // for all transitions except the one to the start state
     for (size_t i = 0; i < L; i++) {
-      size_t symbol = s.isequence(i);
+      size_t symbol = s.symbol(i);
       if (symbol == empty_symbol)
-        for (auto k : targets.transition)
-          t(k, start_state) += f(i, k) * transition(k, start_state)
+        for (auto k : targets.transition) {
+          T(k, start_state) += f(i, k) * transition(k, start_state)
                                * b(i + 1, start_state);
+          if (reduce[k] != -1)
+            T_r(k, start_state) += f_r(i, k) * transition(k, start_state)
+                                   * b_r(i + 1, start_state);
+        }
       else
-        // TODO change the order of the loops
         for (auto k : targets.transition) {
           double f_i_k = f(i, k);
-          for (auto suc : succ[k])
-            t(k, suc) += f_i_k * transition(k, suc) * emission(suc, symbol)
+          for (size_t e = from.offset[k]; e < from.offset[k + 1]; e++) {
+            size_t suc = from.index[e];
+            T(k, suc) += f_i_k * from.prob[e] * emission(suc, symbol)
                          * b(i + 1, suc);
+          }
+          if (reduce[k] != -1) {
+            double f_r_i_k = f_r(i, k);
+            for (size_t e = from.offset[k]; e < from.offset[k + 1]; e++) {
+              size_t suc = from.index[e];
+              if (reduce[suc] != -1)
+                T_r(k, suc) += f_r_i_k * from.prob[e] * emission(suc, symbol)
+                               * b_r(i + 1, suc);
+            }
+          }
         }
     }
 
     // for the transition to the start_state
-    for (auto pre : pred[start_state])
-      t(pre, start_state) += f(L, pre) * transition(pre, start_state)
-                             * b(L + 1, start_state);
-
-    if (verbosity >= Verbosity::debug)
-      cerr << "t = " << t << endl;
-
-#pragma omp critical(update_T)
-    T += t;
+    for (size_t e = to.offset[start_state]; e < to.offset[start_state + 1];
+         e++) {
+      size_t pre = to.index[e];
+      T(pre, start_state) += f(L, pre) * to.prob[e] * b(L + 1, start_state);
+      if (reduce[pre] != -1)
+        T_r(pre, start_state) += f_r(L, pre) * to.prob[e]
+                                 * b_r(L + 1, start_state);
+    }
   }
 
   if (not targets.emission.empty()) {
-    matrix_t e = zero_matrix(n_states, n_emissions);
+    if (not(E.size1() == n_states and E.size2() == n_emissions))
+      E = zero_matrix(n_states, n_emissions);
+    if (not(E_r.size1() == n_states and E_r.size2() == n_emissions))
+      E_r = zero_matrix(n_states, n_emissions);
 
     for (size_t i = 0; i < L; i++) {
-      size_t symbol = s.isequence(i);
+      size_t symbol = s.symbol(i);
       if (symbol != empty_symbol)
-        for (auto k : targets.emission)
-          e(k, symbol) += f(i + 1, k) * b(i + 1, k) * scale(i + 1);
+        for (auto k : targets.emission) {
+          E(k, symbol) += f(i + 1, k) * b(i + 1, k) * scale(i + 1);
+          if (reduce[k] != -1)
+            E_r(k, symbol) += f_r(i + 1, k) * b_r(i + 1, k) * scale_r(i + 1);
+        }
     }
-
-    if (verbosity >= Verbosity::debug)
-      cerr << "e = " << e << endl;
-
-#pragma omp critical(update_E)
-    E += e;
   }
-  if (verbosity >= Verbosity::debug)
-    cout << "Done BaumWelchIteration(Seq) log_likel = " << log_likel << endl;
   return log_likel;
 }
 
@@ -369,45 +621,77 @@ double HMM::ViterbiIteration(matrix_t &T, matrix_t &E,
                              const Data::Collection &collection,
                              const Training::Targets &targets,
                              const Options::HMM &options) {
-  double log_likel = 0;
-  for (auto &contrast : collection)
-    for (auto &dataset : contrast)
-      log_likel += ViterbiIteration(T, E, dataset, targets, options);
-  return log_likel;
+  return ViterbiIteration(T, E, Schedule::data_sets(collection), targets);
 }
 
 double HMM::ViterbiIteration(matrix_t &T, matrix_t &E, const Data::Set &dataset,
-                             const Training::Targets &training_targets,
+                             const Training::Targets &targets,
                              const Options::HMM &options) {
+  return ViterbiIteration(T, E, Schedule::Sets{&dataset}, targets);
+}
+
+double HMM::ViterbiIteration(matrix_t &T, matrix_t &E,
+                             const Schedule::Sets &sets,
+                             const Training::Targets &training_targets) {
   double log_likel = 0;
-#pragma omp parallel for reduction(+ : log_likel) shared(E, T) if (DO_PARALLEL)
-  for (size_t j = 0; j < dataset.sequences.size(); j++) {
+  vector<matrix_t> t_counts, e_counts;  // thread-local counts
+
+  const auto tasks = Schedule::by_length(sets);
+  Schedule::Utilization::Loop loop_timer;
+#pragma omp parallel shared(E, T, t_counts, e_counts) if (DO_PARALLEL)
+  {
+#pragma omp single
+    {
+      size_t n_threads = omp_get_num_threads();
+      if (not training_targets.transition.empty())
+        t_counts
+            = vector<matrix_t>(n_threads, zero_matrix(n_states, n_states));
+      if (not training_targets.emission.empty())
+        e_counts
+            = vector<matrix_t>(n_threads, zero_matrix(n_states, n_emissions));
+    }
+
+    size_t thread_idx = omp_get_thread_num();
     StatePath path;
-    double cur_log_likel = viterbi(dataset.sequences[j], path);
 
-    size_t L = dataset.sequences[j].isequence.size();
+#pragma omp for schedule(dynamic) reduction(+ : log_likel)
+    for (size_t k = 0; k < tasks.size(); k++) {
+      Schedule::Utilization::Item item_timer;
+      const Data::Seq &seq = sets[tasks[k].set]->sequences[tasks[k].seq];
+      const double weight = sets[tasks[k].set]->multiplicity[tasks[k].seq];
+      double cur_log_likel = viterbi(seq, path);
+
+      size_t L = seq.size();
+
+      if (not training_targets.transition.empty()) {
+        matrix_t &t = t_counts[thread_idx];
+        t(start_state, path[0]) += weight;
+        for (size_t i = 0; i < L - 1; i++)
+          t(path[i], path[i + 1]) += weight;
+        t(path[L - 1], start_state) += weight;
+      }
+
+      if (not training_targets.emission.empty()) {
+        matrix_t &e = e_counts[thread_idx];
+        for (size_t i = 0; i < L; i++)
+          e(path[i], seq.symbol(i)) += weight;
+      }
 
-    matrix_t t = zero_matrix(n_states, n_states);
-    if (not training_targets.transition.empty()) {
-      t(start_state, path[0]) += 1;
-      for (size_t i = 0; i < L - 1; i++)
-        t(path[i], path[i + 1]) += 1;
-      t(path[L - 1], start_state) += 1;
+      log_likel += weight * cur_log_likel;
     }
 
-    matrix_t e = zero_matrix(n_states, n_emissions);
+    if (not training_targets.transition.empty())
+      tree_reduce(t_counts);
     if (not training_targets.emission.empty())
-      for (size_t i = 0; i < L; i++)
-        e(path[i], dataset.sequences[j].isequence[i]) += 1;
+      tree_reduce(e_counts);
 
-#pragma omp critical
+#pragma omp single
     {
       if (not training_targets.emission.empty())
-        E += e;
+        E += e_counts[0];
       if (not training_targets.transition.empty())
-        T += t;
+        T += t_counts[0];
     }
-    log_likel += cur_log_likel;
   }
   return log_likel;
 }
@@ -489,9 +773,13 @@ void HMM::M_Step(const matrix_t &T_, const matrix_t &E_,
   for (auto t : targets.transition)
     for (size_t j = 0; j < n_states; j++)
       transition(t, j) = T(t, j);
+  if (not targets.transition.empty())
+    compile_transitions();
   for (auto t : targets.emission)
     for (size_t j = 0; j < n_emissions; j++)
       emission(t, j) = E(t, j);
+  if (not targets.emission.empty())
+    compile_emissions();
 
   if (verbosity >= Verbosity::verbose) {
     if (not targets.transition.empty())
@@ -625,10 +913,13 @@ Training::State HMM::iterative_training(const Data::Collection &collection,
 
   Gradient gradient, conjugate;
   size_t cg_niter = 0;
+  LBFGSMemory lbfgs;
+  StochasticState sgd(options.random_salt);
   while ((iteration++ < options.termination.max_iter
           or options.termination.max_iter == 0)
          and perform_training_iteration(collection, tasks, options, state,
-                                        gradient, conjugate, cg_niter))
+                                        gradient, conjugate, cg_niter, lbfgs,
+                                        sgd))
     if (verbosity >= Verbosity::info) {
       cout << endl << "Iteration                                      "
            << iteration << endl;
@@ -660,7 +951,8 @@ Training::State HMM::iterative_training(const Data::Collection &collection,
 bool HMM::perform_training_iteration(
     const Data::Collection &collection, const Training::Tasks &tasks,
     const Options::HMM &options, Training::State &state,
-    Gradient &prev_gradient, Gradient &prev_conjugate, size_t &cg_niter) {
+    Gradient &prev_gradient, Gradient &prev_conjugate, size_t &cg_niter,
+    LBFGSMemory &lbfgs, StochasticState &sgd) {
   bool done = true;
 
   size_t task_idx = 0;
@@ -708,10 +1000,16 @@ bool HMM::perform_training_iteration(
         score
             = *(state.scores[task_idx].rbegin() + options.termination.past - 1);
 
-      if (Training::measure2method(task.measure) == Training::Method::Gradient)
-        done = perform_training_iteration_gradient(
-                   collection, task, options, state.center, score,
-                   prev_gradient, prev_conjugate, cg_niter) and done;
+      if (Training::measure2method(task.measure) == Training::Method::Gradient) {
+        if (options.stochastic.do_stochastic)
+          done = perform_training_iteration_stochastic(collection, task,
+                                                       options, score, sgd)
+                 and done;
+        else
+          done = perform_training_iteration_gradient(
+                     collection, task, options, state.center, score,
+                     prev_gradient, prev_conjugate, cg_niter, lbfgs) and done;
+      }
 
       if (Training::measure2method(task.measure)
           == Training::Method::Reestimation)
@@ -752,35 +1050,39 @@ bool HMM::reestimate_class_parameters(const Data::Collection &collection,
   double l = 0;
   const double marginal_motif_prior
       = registration.compute_marginal_motif_prior(present);
-  for (auto &contrast : collection)
-    for (auto &dataset : contrast) {
-      const double class_cond
-          = registration.get_class_motif_prior(dataset.sha1, present);
-      const double log_class_prior
-          = log(registration.get_class_prior(dataset.sha1));
-
-      double motif_count = 0;
-#pragma omp parallel for schedule(static) \
-    reduction(+ : l, motif_count) if (DO_PARALLEL)
-      for (size_t i = 0; i < dataset.set_size; i++) {
-        posterior_t res = posterior_atleast_one(dataset.sequences[i], present);
-        double p = res.posterior;
-        double x = log_class_prior + log(p * class_cond / marginal_motif_prior
-                                         + (1 - p) * (1 - class_cond)
-                                           / (1 - marginal_motif_prior));
-        if (task.measure == Measure::ClassificationLikelihood)
-          x += res.log_likelihood;
-        if (verbosity >= Verbosity::debug)
-          cout << "Sequence " << dataset.sequences[i].definition << " p = " << p
-               << " class log likelihood = " << x << " exp -> " << exp(x)
-               << endl;
-        motif_count += p;
-        l += x;
-      }
-      motif_counts[dataset.sha1] += motif_count;
+  const auto sets = Schedule::data_sets(collection);
+  auto subhmm = sub_model(present);
+  auto posteriors = Schedule::map_sequences<posterior_t>(
+      sets, [&](size_t, const Data::Seq &seq) {
+        return posterior_atleast_one(seq, *subhmm);
+      });
+  for (size_t set_idx = 0; set_idx < sets.size(); set_idx++) {
+    const Data::Set &dataset = *sets[set_idx];
+    const double class_cond
+        = registration.get_class_motif_prior(dataset.sha1, present);
+    const double log_class_prior
+        = log(registration.get_class_prior(dataset.sha1));
+
+    double motif_count = 0;
+    for (size_t i = 0; i < dataset.set_size; i++) {
+      const posterior_t &res = posteriors[set_idx][i];
+      double p = res.posterior;
+      double x = log_class_prior + log(p * class_cond / marginal_motif_prior
+                                       + (1 - p) * (1 - class_cond)
+                                         / (1 - marginal_motif_prior));
+      if (task.measure == Measure::ClassificationLikelihood)
+        x += res.log_likelihood;
       if (verbosity >= Verbosity::debug)
-        cout << "Data::Set " << dataset.path << " l = " << l << endl;
+        cout << "Sequence " << dataset.sequences[i].definition << " p = " << p
+             << " class log likelihood = " << x << " exp -> " << exp(x)
+             << endl;
+      motif_count += p;
+      l += x;
     }
+    motif_counts[dataset.sha1] += motif_count;
+    if (verbosity >= Verbosity::debug)
+      cout << "Data::Set " << dataset.path << " l = " << l << endl;
+  }
 
   // add pseudo counts
   double class_z = 0;
@@ -882,6 +1184,7 @@ Gradient compute_conjugate(Gradient gradient, Gradient &prev_gradient,
 
     switch (cg_options.mode) {
       case Options::Conjugate::Mode::None:
+      case Options::Conjugate::Mode::LBFGS:
         break;
       case Options::Conjugate::Mode::FletcherReeves:
         beta = scalar_product(gradient, gradient)
@@ -929,10 +1232,123 @@ Gradient compute_conjugate(Gradient gradient, Gradient &prev_gradient,
   return conjugate;
 }
 
+/** The log-transformed parameters of the rows subject to a task, with the
+ * shape of the gradient, and zero elsewhere and where probabilities vanish */
+Gradient log_parameters(const matrix_t &transition, const matrix_t &emission,
+                        const Training::Targets &targets,
+                        const Gradient &shape) {
+  auto extract = [](const matrix_t &m, const Training::Range &rows,
+                    const matrix_t &like) {
+    matrix_t x = zero_matrix(like.size1(), like.size2());
+    for (auto i : rows)
+      if (i < x.size1())
+        for (size_t j = 0; j < x.size2(); j++)
+          if (m(i, j) > 0)
+            x(i, j) = log(m(i, j));
+    return x;
+  };
+  Gradient x;
+  x.transition = extract(transition, targets.transition, shape.transition);
+  x.emission = extract(emission, targets.emission, shape.emission);
+  return x;
+}
+
+/** Limited-memory BFGS ascent direction, by the two-loop recursion of
+ * Nocedal, J. (1980). Updating quasi-Newton matrices with limited storage.
+ * Mathematics of Computation, 35(151), 773-782.
+ * The correction pair of the last iteration is only used if the parameters
+ * were not changed by other means since the last line search, as in hybrid
+ * learning, and if it has positive curvature; otherwise the memory is
+ * cleared. The direction is scaled so that its norm equals the directional
+ * derivative of the gradient along it, which the line search assumes. */
+Gradient compute_lbfgs_direction(const Gradient &gradient,
+                                 const Gradient &parameters,
+                                 Gradient &prev_gradient, LBFGSMemory &memory,
+                                 const Options::Conjugate &cg_options,
+                                 size_t &cg_niter) {
+  auto axpy = [](double a, const Gradient &x, Gradient &y) {
+    y.transition += a * x.transition;
+    y.emission += a * x.emission;
+  };
+  auto same_shape = [](const Gradient &a, const Gradient &b) {
+    return a.transition.size1() == b.transition.size1()
+           and a.transition.size2() == b.transition.size2()
+           and a.emission.size1() == b.emission.size1()
+           and a.emission.size2() == b.emission.size2();
+  };
+  auto same = [&same_shape](const Gradient &a, const Gradient &b) {
+    return same_shape(a, b)
+           and std::equal(a.transition.data().begin(),
+                          a.transition.data().end(),
+                          b.transition.data().begin())
+           and std::equal(a.emission.data().begin(), a.emission.data().end(),
+                          b.emission.data().begin());
+  };
+
+  if (same_shape(gradient, prev_gradient)
+      and same_shape(parameters, memory.start)
+      and same(parameters, memory.accepted)) {
+    Gradient s = parameters, y = prev_gradient;
+    axpy(-1, memory.start, s);
+    axpy(-1, gradient, y);
+    if (scalar_product(s, y) > 0)
+      memory.pairs.push_back(make_pair(s, y));
+    else
+      memory.pairs.clear();
+  } else
+    memory.pairs.clear();
+
+  if (cg_options.restart_iteration > 0 and cg_niter >= cg_options.restart_iteration) {
+    memory.pairs.clear();
+    cg_niter = 0;
+  }
+  while (memory.pairs.size() > cg_options.memory)
+    memory.pairs.pop_front();
+
+  memory.start = parameters;
+  memory.accepted = Gradient();
+  prev_gradient = gradient;
+  cg_niter++;
+
+  Gradient direction = gradient;
+  const size_t m = memory.pairs.size();
+  vector<double> alpha(m), rho(m);
+  for (size_t k = m; k-- > 0;) {
+    const auto &pair = memory.pairs[k];
+    rho[k] = 1 / scalar_product(pair.first, pair.second);
+    alpha[k] = rho[k] * scalar_product(pair.first, direction);
+    axpy(-alpha[k], pair.second, direction);
+  }
+  if (m > 0) {
+    const auto &last = memory.pairs.back();
+    double gamma = scalar_product(last.first, last.second)
+                   / scalar_product(last.second, last.second);
+    direction.transition *= gamma;
+    direction.emission *= gamma;
+  }
+  for (size_t k = 0; k < m; k++) {
+    const auto &pair = memory.pairs[k];
+    double beta = rho[k] * scalar_product(pair.second, direction);
+    axpy(alpha[k] - beta, pair.first, direction);
+  }
+
+  double slope = scalar_product(gradient, direction);
+  if (not(slope > 0)) {
+    // not an ascent direction; restart with steepest ascent
+    memory.pairs.clear();
+    return gradient;
+  }
+  double scale = slope / scalar_product(direction, direction);
+  direction.transition *= scale;
+  direction.emission *= scale;
+  return direction;
+}
+
 bool HMM::perform_training_iteration_gradient(
     const Data::Collection &collection, const Training::Task &task,
     const Options::HMM &options, int &center, double &score,
-    Gradient &prev_gradient, Gradient &prev_conjugate, size_t &cg_niter) {
+    Gradient &prev_gradient, Gradient &prev_conjugate, size_t &cg_niter,
+    LBFGSMemory &lbfgs) {
   if (verbosity >= Verbosity::verbose)
     cerr << "HMM::perform_training_iteration_gradient" << endl;
 
@@ -970,7 +1386,17 @@ bool HMM::perform_training_iteration_gradient(
     cout << "The transition gradient is : " << gradient.transition << endl
          << "The emission gradient is : " << gradient.emission << endl;
 
-  if (options.conjugate.mode != Options::Conjugate::Mode::None) {
+  const bool use_lbfgs
+      = options.conjugate.mode == Options::Conjugate::Mode::LBFGS;
+  if (use_lbfgs) {
+    gradient = compute_lbfgs_direction(
+        gradient, log_parameters(transition, emission, task.targets, gradient),
+        prev_gradient, lbfgs, options.conjugate, cg_niter);
+    if (verbosity >= Verbosity::verbose)
+      cout << "The transition L-BFGS direction is : " << gradient.transition
+           << endl << "The emission L-BFGS direction is : "
+           << gradient.emission << endl;
+  } else if (options.conjugate.mode != Options::Conjugate::Mode::None) {
     gradient = compute_conjugate(gradient, prev_gradient, prev_conjugate,
                                  options.conjugate, cg_niter);
     if (verbosity >= Verbosity::verbose)
@@ -1011,9 +1437,14 @@ bool HMM::perform_training_iteration_gradient(
     if (verbosity >= Verbosity::info)
       cout << "Skipping line search. Gradient norm is zero." << endl;
   } else {
-    int info;
-    pair<double, HMM> res = line_search_more_thuente(
-        collection, gradient, previous_score, info, task, options);
+    int info = 0;
+    pair<double, HMM> res(previous_score, *this);
+    if (options.line_search.concurrent_steps > 1)
+      res = line_search_speculative(collection, gradient, previous_score, info,
+                                    task, options, center);
+    if (info != 1)
+      res = line_search_more_thuente(collection, gradient, previous_score,
+                                     info, task, options);
     if (info != 1)
       cout << "Line search exit status: " << info << " - "
            << line_search_status(info) << endl;
@@ -1084,6 +1515,9 @@ bool HMM::perform_training_iteration_gradient(
     done = rel_score_criterion or grad_norm_criterion;
     score = new_score;
     *this = candidate;
+    if (use_lbfgs)
+      lbfgs.accepted
+          = log_parameters(transition, emission, task.targets, gradient);
   } else {
     score = previous_score;
   }
@@ -1091,6 +1525,157 @@ bool HMM::perform_training_iteration_gradient(
   return done;
 }
 
+/** Adaptive step on the log-transformed parameters from a mini-batch gradient,
+ * following
+ * Kingma, D. P., & Ba, J. (2015). Adam: A method for stochastic optimization.
+ * International Conference on Learning Representations. */
+Gradient adaptive_step(const Gradient &gradient, StochasticState &sgd,
+                       double learning_rate) {
+  const double beta1 = 0.9;
+  const double beta2 = 0.999;
+  const double eps = 1e-8;
+
+  auto same_shape = [](const matrix_t &a, const matrix_t &b) {
+    return a.size1() == b.size1() and a.size2() == b.size2();
+  };
+  if (not same_shape(gradient.transition, sgd.first_moment.transition)
+      or not same_shape(gradient.emission, sgd.first_moment.emission)) {
+    // the model changed; start afresh
+    sgd.first_moment.transition
+        = zero_matrix(gradient.transition.size1(), gradient.transition.size2());
+    sgd.first_moment.emission
+        = zero_matrix(gradient.emission.size1(), gradient.emission.size2());
+    sgd.second_moment = sgd.first_moment;
+    sgd.n_steps = 0;
+  }
+  sgd.n_steps++;
+  const double c1 = 1 - pow(beta1, sgd.n_steps);
+  const double c2 = 1 - pow(beta2, sgd.n_steps);
+
+  auto update = [&](const matrix_t &g, matrix_t &m, matrix_t &v) {
+    matrix_t step(g.size1(), g.size2());
+    for (size_t i = 0; i < g.size1(); i++)
+      for (size_t j = 0; j < g.size2(); j++) {
+        m(i, j) = beta1 * m(i, j) + (1 - beta1) * g(i, j);
+        v(i, j) = beta2 * v(i, j) + (1 - beta2) * g(i, j) * g(i, j);
+        step(i, j) = learning_rate * m(i, j) / c1
+                     / (sqrt(v(i, j) / c2) + eps);
+      }
+    return step;
+  };
+
+  Gradient step;
+  step.transition = update(gradient.transition, sgd.first_moment.transition,
+                           sgd.second_moment.transition);
+  step.emission = update(gradient.emission, sgd.first_moment.emission,
+                         sgd.second_moment.emission);
+  return step;
+}
+
+bool HMM::perform_training_iteration_stochastic(
+    const Data::Collection &collection, const Training::Task &task,
+    const Options::HMM &options, double &score, StochasticState &sgd) {
+  if (verbosity >= Verbosity::verbose)
+    cerr << "HMM::perform_training_iteration_stochastic" << endl;
+
+  HMM previous = *this;
+
+  // the objective of the model we start from; other tasks, like background
+  // re-estimation, may have changed the parameters since the last iteration
+  Timer timer;
+  double past_score;
+  compute_gradient(collection, past_score, task, options.weighting);
+  double score_time = timer.tock();
+  if (options.timing_information)
+    cerr << "Score computation time: " + time_to_pretty_string(score_time)
+         << endl;
+
+  timer.tick();
+  double batch_score = 0;
+  for (size_t step = 0; step < options.stochastic.n_steps; step++) {
+    Data::Collection batch = sample_mini_batch(
+        collection, options.stochastic.batch_size, sgd.rng);
+    double s;
+    Gradient gradient = compute_gradient(batch, s, task, options.weighting);
+    batch_score += s;
+    Gradient update
+        = adaptive_step(gradient, sgd, options.stochastic.learning_rate);
+    double update_norm = sqrt(scalar_product(update, update));
+    if (update_norm > 0)
+      *this = build_trial_model(update, update_norm, task);
+    if (verbosity >= Verbosity::verbose)
+      cout << "Mini-batch step " << step << " score = " << s
+           << " step norm = " << update_norm << endl;
+  }
+  if (options.stochastic.n_steps > 0)
+    batch_score /= options.stochastic.n_steps;
+  double steps_time = timer.tock();
+  if (options.timing_information)
+    cerr << "Mini-batch steps time: " + time_to_pretty_string(steps_time)
+         << endl;
+
+  double new_score;
+  Gradient gradient
+      = compute_gradient(collection, new_score, task, options.weighting);
+
+  double score_difference = new_score - past_score;
+  double relative_score_difference = score_difference / fabs(new_score);
+
+  if (verbosity >= Verbosity::info)
+    for (size_t group_idx = 0; group_idx < groups.size(); group_idx++)
+      if (groups[group_idx].name == task.motif_name)
+        if (is_motif_group(group_idx))
+          cout << "Motif gradient                                 "
+               << groups[group_idx].name << ":"
+               << get_group_consensus(gradient.emission, group_idx)
+               << endl;
+  if (verbosity >= Verbosity::info)
+    cout << "Mini-batch score                               " << batch_score
+         << endl << "Score                                          "
+         << new_score << endl
+         << "Stochastic learning, relative score difference "
+         << relative_score_difference << endl;
+
+  if (score_difference < 0) {
+    cout << "Warning: negative score difference during stochastic gradient "
+            "learning iteration! Discarding iteration." << endl;
+    *this = previous;
+    score = past_score;
+    // do not carry momentum from the rejected steps
+    sgd.first_moment = sgd.second_moment = Gradient();
+    sgd.n_steps = 0;
+    return true;
+  }
+
+  matrix_t a = emission;
+  matrix_t b = transition;
+  log_transform(a);
+  log_transform(b);
+  for (size_t i = 0; i < a.size1(); i++)
+    for (size_t j = 0; j < a.size2(); j++)
+      if (std::isinf(a(i, j)))
+        a(i, j) = 0;
+  for (size_t i = 0; i < b.size1(); i++)
+    for (size_t j = 0; j < b.size2(); j++)
+      if (std::isinf(b(i, j)))
+        b(i, j) = 0;
+
+  double xnorm = norml2(a) + norml2(b);
+  double gnorm = norml2(gradient.emission) + norml2(gradient.transition);
+
+  bool rel_score_criterion = relative_score_difference
+                             < options.termination.delta_tolerance;
+  bool grad_norm_criterion = gnorm < options.termination.epsilon_tolerance
+                                     * max<double>(1, xnorm);
+  if (rel_score_criterion)
+    cout << "Relative score criterion                       OK" << endl;
+  if (grad_norm_criterion)
+    cout << "Gradient norm criterion                        OK" << endl;
+  score = new_score;
+
+  return rel_score_criterion or grad_norm_criterion;
+}
+
 namespace Exception {
 namespace HMM {
 namespace Learning {
@@ -27,6 +27,8 @@
  * =====================================================================================
  */
 
+#include <omp.h>
+#include <algorithm>
 #include <iomanip>
 #include "../timer.hpp"
 #include "../aux.hpp"
@@ -110,10 +112,14 @@ HMM HMM::build_trial_model(const Gradient &gradient, double alpha,
   }
 
   HMM trial_hmm(*this);
-  if (not task.targets.transition.empty())
+  if (not task.targets.transition.empty()) {
     trial_hmm.transition = t_step;
-  if (not task.targets.emission.empty())
+    trial_hmm.compile_transitions();
+  }
+  if (not task.targets.emission.empty()) {
     trial_hmm.emission = e_step;
+    trial_hmm.compile_emissions();
+  }
 
   return trial_hmm;
 }
@@ -173,6 +179,114 @@ Gradient normalize(const Gradient &gradient) {
   return u;
 }
 
+/** Lower and upper bound of the step length in the line search along a
+ * direction with directional derivative dginit */
+pair<double, double> step_bounds(double initial_score, double dginit,
+                                 const Training::Task &task,
+                                 const Options::HMM &options,
+                                 Verbosity verbo) {
+  // TODO determine alpha_min and alpha_max
+  const double min_score = initial_score
+                           / (1 - options.termination.delta_tolerance);
+  const double stpmin = (min_score - initial_score) / dginit;
+  // const double stpmin = (min_score - initial_score) / options.line_search.mu / dginit;
+  if (verbo >= Verbosity::debug) {
+    cout << "min_score = " << min_score << endl;
+    cout << "stpmin= " << stpmin << endl;
+  }
+  // double alpha_max = 1.0 / options.line_search.mu * (min_score - initial_score) / gradient_sum(initial_gradient);
+
+  double upper_limit = 10000;
+  if (task.measure == Measure::MutualInformation
+      or task.measure == Measure::MatthewsCorrelationCoefficient)
+    upper_limit = (1 - initial_score) / options.line_search.mu
+                  / dginit;  // Assume the maximal score is 1
+  if (verbo >= Verbosity::debug)
+    cout << "Upper limit = " << upper_limit << endl;
+  double strict_upper_limit = min(upper_limit + 1, upper_limit * 1.1);
+  if (verbo >= Verbosity::debug)
+    cout << "Strict upper limit = " << strict_upper_limit << endl;
+
+  return make_pair(stpmin, strict_upper_limit);
+}
+
+/** Speculative line search: a geometric bracket of step lengths around the
+ * previously accepted one, 2^center, is evaluated concurrently, with the
+ * available threads divided among the steps. Of the steps that fulfill the
+ * same conditions by which the Moré-Thuente line search accepts a step, the
+ * one with the highest score is returned, and info is set to 1. If there is
+ * none, info is 0 and the caller falls back to the sequential search. */
+pair<double, HMM> HMM::line_search_speculative(
+    const Data::Collection &collection, const Gradient &initial_gradient,
+    double initial_score, int &info, const Training::Task &task,
+    const Options::HMM &options, int &center) const {
+  info = 0;
+
+  const Gradient direction = normalize(initial_gradient);
+  const double dginit = dderiv(direction, initial_gradient);
+  if (dginit <= 0 or options.line_search.eta <= options.line_search.mu)
+    return pair<double, HMM>(initial_score, *this);
+
+  const auto bounds
+      = step_bounds(initial_score, dginit, task, options, verbosity);
+
+  const int n = options.line_search.concurrent_steps;
+  vector<double> steps;
+  for (int k = 0; k < n; k++) {
+    double stp = ldexp(1.0, center + k - n / 2);
+    stp = min(max(stp, bounds.first), bounds.second);
+    if (find(begin(steps), end(steps), stp) == end(steps))
+      steps.push_back(stp);
+  }
+
+  vector<HMM> trials;
+  for (auto stp : steps)
+    trials.push_back(build_trial_model(initial_gradient, stp, task));
+  vector<double> scores(steps.size()), derivs(steps.size());
+
+  const size_t n_threads = omp_get_max_threads();
+  const size_t n_teams = min(n_threads, steps.size());
+  const int max_active_levels = omp_get_max_active_levels();
+  omp_set_max_active_levels(2);
+#pragma omp parallel for schedule(dynamic) num_threads(n_teams)
+  for (size_t i = 0; i < steps.size(); i++) {
+    omp_set_num_threads(max<size_t>(1, n_threads / n_teams));
+    Gradient g = trials[i].compute_gradient(collection, scores[i], task,
+                                            options.weighting);
+    derivs[i] = dderiv(direction, g);
+  }
+  omp_set_max_active_levels(max_active_levels);
+
+  const double ftol = options.line_search.mu;
+  const double gtol = options.line_search.eta;
+  int accepted = -1;
+  size_t best = 0;
+  for (size_t i = 0; i < steps.size(); i++) {
+    bool wolfe = scores[i] >= initial_score + steps[i] * ftol * dginit
+                 and fabs(derivs[i]) <= gtol * fabs(dginit);
+    if (verbosity >= Verbosity::verbose)
+      cout << "stp = " << steps[i] << " f = " << scores[i]
+           << " dg = " << derivs[i] << (wolfe ? " accepted" : "") << endl;
+    if (wolfe and (accepted < 0 or scores[i] > scores[accepted]))
+      accepted = i;
+    if (scores[i] > scores[best])
+      best = i;
+  }
+
+  if (verbosity >= Verbosity::info)
+    cout << "Concurrent evaluations in line search          " << steps.size()
+         << endl;
+
+  if (accepted >= 0)
+    best = accepted;
+  center = lround(log2(steps[best]));
+
+  if (accepted < 0)
+    return pair<double, HMM>(initial_score, *this);
+  info = 1;
+  return pair<double, HMM>(scores[accepted], trials[accepted]);
+}
+
 /** Line-searching algorithm due to
  * Jorge J. Moré and David J. Thuente.
  * Line Search Algorithms with Guaranteed Sufficient Decrease
@@ -248,31 +362,10 @@ pair<double, HMM> HMM::line_search_more_thuente(
   if (failed)
     return pair<double, HMM>(initial_score, *this);
 
-  // TODO determine alpha_min and alpha_max
-  const double min_score = initial_score
-                           / (1 - options.termination.delta_tolerance);
-  const double stpmin = (min_score - initial_score)
-                        / dderiv(direction, initial_gradient);
-  // const double stpmin = (min_score - initial_score) / options.line_search.mu / dderiv(direction, initial_gradient);
-  if (verbo >= Verbosity::debug) {
-    cout << "min_score = " << min_score << endl;
-    cout << "stpmin= " << stpmin << endl;
-  }
-  // double alpha_max = 1.0 / options.line_search.mu * (min_score - initial_score) / gradient_sum(initial_gradient);
-
-  double upper_limit = 10000;
-  if (task.measure == Measure::MutualInformation
-      or task.measure == Measure::MatthewsCorrelationCoefficient)
-    upper_limit = (1 - initial_score) / options.line_search.mu
-                  / dderiv(direction,
-                           initial_gradient);  // Assume the maximal score is 1
-  if (verbo >= Verbosity::debug)
-    cout << "Upper limit = " << upper_limit << endl;
-  double strict_upper_limit = min(upper_limit + 1, upper_limit * 1.1);
-  if (verbo >= Verbosity::debug)
-    cout << "Strict upper limit = " << strict_upper_limit << endl;
-
-  double stpmax = strict_upper_limit;
+  const auto bounds
+      = step_bounds(initial_score, dginit, task, options, verbo);
+  const double stpmin = bounds.first;
+  double stpmax = bounds.second;
 
   const double xtrapf = 4;
   const double xtol = 1e-10;
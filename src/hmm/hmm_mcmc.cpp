@@ -50,6 +50,7 @@ void HMM::modify_column(mt19937 &rng) {
   double amount = emission(col, i) * rel_amount;
   emission(col, i) -= amount;
   emission(col, j) += amount;
+  compile_emissions();
 }
 
 void HMM::modify_transition(mt19937 &rng, double eps) {
@@ -86,6 +87,7 @@ void HMM::modify_transition(mt19937 &rng, double eps) {
     z += transition(col, i);
   for (size_t i = 0; i < n_states; i++)
     transition(col, i) /= z;
+  compile_transitions();
 }
 
 HMM HMM::random_variant(const Options::HMM &options, mt19937 &rng) const {
@@ -153,6 +155,7 @@ void HMM::swap_columns(mt19937 &rng) {
     emission(i, k) = emission(j, k);
     emission(j, k) = temp;
   }
+  compile_emissions();
 }
 
 void HMM::add_column(size_t n, const vector<double> &e) {
@@ -58,6 +58,8 @@ istream &operator>>(istream &is, Conjugate::Mode &conjugate) {
     conjugate = Conjugate::Mode::HestenesStiefel;
   else if (token == "dy" or token == "daiyan" or token == "daiyan")
     conjugate = Conjugate::Mode::DaiYuan;
+  else if (token == "lbfgs")
+    conjugate = Conjugate::Mode::LBFGS;
   else
     throw Exception::Optimization::InvalidConjugate(token);
   return is;
@@ -163,6 +165,15 @@ ostream &operator<<(ostream &os, const Sampling &options) {
   return os;
 }
 
+ostream &operator<<(ostream &os, const Stochastic &options) {
+  os << "Stochastic gradient options:" << endl
+     << "do_stochastic = " << options.do_stochastic << endl
+     << "batch_size = " << options.batch_size << endl
+     << "n_steps = " << options.n_steps << endl
+     << "learning_rate = " << options.learning_rate << endl;
+  return os;
+}
+
 ostream &operator<<(ostream &os, const ExecutionInformation &exec_info) {
   os << "ExecutionInformation:" << endl << "STUB!" << endl;
   return os;
@@ -190,7 +201,8 @@ ostream &operator<<(ostream &os, const HMM &options) {
      // implement
      << "evaluation_options = " << options.evaluate << endl
      << "n_threads = " << options.n_threads << endl
-     << "n_seq = " << options.n_seq << endl << "alpha = " << options.alpha
+     << "n_seq = " << options.n_seq << endl
+     << "cache_directory = " << options.cache_directory << endl << "alpha = " << options.alpha
      << endl
      << "contingency_pseudo_count = " << options.contingency_pseudo_count
      << endl << "emission_pseudo_count = " << options.emission_pseudo_count
@@ -210,6 +222,7 @@ ostream &operator<<(ostream &os, const HMM &options) {
      << "cross_validation_iterations = " << options.cross_validation_iterations
      << endl << "cross_validation_freq = " << options.cross_validation_freq
      << endl << "store_intermediate = " << options.store_intermediate << endl
+     << "checkpoint_memory = " << options.checkpoint_memory << endl
      << "wiggle = " << options.wiggle << endl
      << "line_search = " << options.line_search << endl
      << "random_salt = " << options.random_salt << endl
@@ -226,6 +239,7 @@ ostream &operator<<(ostream &os, const HMM &options) {
      << "limit_logp = " << options.limit_logp << endl
      << "miseeding = " << options.use_mi_to_seed << endl
      << "sampling = " << options.sampling << endl
+     << "stochastic = " << options.stochastic << endl
      << "lambda = " << options.lambda << endl
      << "emission_matrix_paths = " << options.emission_matrix_paths << endl
      << "verbosity = " << options.verbosity << endl
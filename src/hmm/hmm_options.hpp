@@ -54,6 +54,13 @@ struct Sampling {
   size_t n_parallel;
 };
 
+struct Stochastic {
+  bool do_stochastic;  // whether to learn gradient tasks from mini-batches
+  size_t batch_size;   // number of sequences per mini-batch
+  size_t n_steps;      // mini-batch steps between full objective evaluations
+  double learning_rate;
+};
+
 struct Termination {
   size_t max_iter, past;
   double gamma_tolerance;
@@ -67,6 +74,7 @@ struct LineSearch {
   double eta;
   double delta = 0.66;
   size_t max_steps;
+  size_t concurrent_steps;  // step lengths evaluated at once; 0 and 1 disable
 };
 
 struct Evaluation {
@@ -85,11 +93,13 @@ struct Conjugate {
     FletcherReeves,
     PolakRibiere,
     HestenesStiefel,
-    DaiYuan
+    DaiYuan,
+    LBFGS
   };
   Mode mode;
   size_t restart_iteration;
   double restart_threshold;
+  size_t memory;  // number of correction pairs kept by L-BFGS
 };
 
 struct MultiMotif {
@@ -122,6 +132,7 @@ struct HMM {
   Evaluation evaluate;
   size_t n_threads;
   size_t n_seq;
+  std::string cache_directory;  // for parsed FASTA files; empty to disable
   double alpha;
   double contingency_pseudo_count, emission_pseudo_count,
       transition_pseudo_count;
@@ -138,6 +149,7 @@ struct HMM {
   size_t cross_validation_iterations;
   double cross_validation_freq;
   bool store_intermediate;  // to write out intermediate parameterizations
+  size_t checkpoint_memory;  // in MB; longer sequences are checkpointed
   size_t wiggle;
   Conjugate conjugate;
   LineSearch line_search;
@@ -158,6 +170,7 @@ struct HMM {
   bool use_mi_to_seed;
 
   Sampling sampling;
+  Stochastic stochastic;
 
   double lambda;
   std::vector<std::string> emission_matrix_paths;
@@ -177,6 +190,7 @@ std::ostream &operator<<(std::ostream &os, const Verbosity &verbosity);
 std::ostream &operator<<(std::ostream &os, const LineSearch &options);
 std::ostream &operator<<(std::ostream &os, const Termination &options);
 std::ostream &operator<<(std::ostream &os, const Sampling &options);
+std::ostream &operator<<(std::ostream &os, const Stochastic &options);
 std::ostream &operator<<(std::ostream &os,
                          const ExecutionInformation &exec_info);
 std::ostream &operator<<(std::ostream &os, const HMM &options);
@@ -193,59 +193,62 @@ double HMM::matthews_correlation_coefficient(const Data::Contrast &contrast,
 
 double HMM::log_likelihood(const Data::Collection &collection) const {
   double l = 0;
-  for (auto &contrast : collection)
-    l += log_likelihood(contrast);
+  for (auto &x : log_likelihoods(Schedule::data_sets(collection)))
+    l += x;
   return l;
 }
 
 double HMM::log_likelihood(const Data::Contrast &contrast) const {
   double l = 0;
-  for (auto &dataset : contrast)
-    l += log_likelihood(dataset);
+  for (auto &x : log_likelihoods(Schedule::data_sets(contrast)))
+    l += x;
+  return l;
+}
+
+vector<double> HMM::log_likelihoods(const Schedule::Sets &sets) const {
+  auto logps = Schedule::map_sequences<double>(
+      sets, [&](size_t, const Data::Seq &seq) { return log_likelihood(seq); });
+  vector<double> l(sets.size(), 0);
+  for (size_t set_idx = 0; set_idx < sets.size(); set_idx++)
+    for (auto &x : logps[set_idx])
+      l[set_idx] += x;
   return l;
 }
 
 double HMM::log_likelihood(const Data::Set &dataset) const {
   double l = 0;
-#pragma omp parallel for schedule(static) reduction(+ : l) if (DO_PARALLEL)
-  for (size_t i = 0; i < dataset.set_size; i++)
-    l += log_likelihood_from_scale(compute_forward_scale(dataset.sequences[i]));
+  const auto &order = Schedule::by_length(dataset);
+  Schedule::Utilization::Loop loop_timer;
+#pragma omp parallel for schedule(dynamic) reduction(+ : l) if (DO_PARALLEL)
+  for (size_t k = 0; k < order.size(); k++) {
+    Schedule::Utilization::Item item_timer;
+    size_t i = order[k];
+    l += dataset.multiplicity[i] * log_likelihood(dataset.sequences[i]);
+  }
   return l;
 }
 
 vector_t HMM::expected_posterior(const Data::Contrast &contrast,
                                  bitmask_t present) const {
+  auto expected = Schedule::map_sequences<double>(
+      Schedule::data_sets(contrast), [&](size_t, const Data::Seq &seq) {
+        return expected_posterior(seq, present);
+      });
   vector_t v = zero_vector(contrast.sets.size());
   for (size_t i = 0; i < contrast.sets.size(); i++)
-    v(i) = expected_posterior(contrast.sets[i], present);
+    for (auto &x : expected[i])
+      v(i) += x;
   return v;
 };
 
-double HMM::expected_posterior(const Data::Set &dataset,
-                               bitmask_t present) const {
-  double m = 0;
-  vector<size_t> present_groups = unpack_mask(present);
-#pragma omp parallel for schedule(static) reduction(+ : m) if (DO_PARALLEL)
-  for (size_t i = 0; i < dataset.set_size; i++) {
-    vector_t scale;
-    matrix_t f = compute_forward_scaled(dataset.sequences[i], scale);
-    matrix_t b = compute_backward_prescaled(dataset.sequences[i], scale);
-    for (auto group_idx : present_groups)
-      // Assume the first state of each motif is constitutive for the motif
-      m += expected_state_posterior(groups[group_idx].states[0], f, b, scale);
-  }
-  return m;
-};
-
 double HMM::expected_posterior(const Data::Seq &seq, bitmask_t present) const {
-  vector<size_t> present_groups = unpack_mask(present);
-  vector_t scale;
-  matrix_t f = compute_forward_scaled(seq, scale);
-  matrix_t b = compute_backward_prescaled(seq, scale);
-  double m = 0;
-  for (auto group_idx : present_groups)
+  vector<size_t> states;
+  for (auto group_idx : unpack_mask(present))
     // Assume the first state of each motif is constitutive for the motif
-    m += expected_state_posterior(groups[group_idx].states[0], f, b, scale);
+    states.push_back(groups[group_idx].states[0]);
+  double m = 0;
+  for (auto expected : expected_state_posteriors(seq, states))
+    m += expected;
   return m;
 };
 
@@ -254,9 +257,15 @@ vector_t HMM::posterior_atleast_one(const Data::Contrast &contrast,
   if (verbosity >= Verbosity::debug)
     cout << "HMM::posterior_atleast_one(Data::Contrast)" << endl
          << "present =" << present << endl;
-  vector_t v(contrast.sets.size());
+  auto subhmm = sub_model(present);
+  auto posteriors = Schedule::map_sequences<double>(
+      Schedule::data_sets(contrast), [&](size_t, const Data::Seq &seq) {
+        return posterior_atleast_one(seq, *subhmm).posterior;
+      });
+  vector_t v = zero_vector(contrast.sets.size());
   for (size_t i = 0; i < contrast.sets.size(); i++)
-    v[i] = sum_posterior_atleast_one(contrast.sets[i], present);
+    for (auto &x : posteriors[i])
+      v[i] += x;
   return v;
 }
 
@@ -268,9 +277,22 @@ HMM::pair_posteriors_t HMM::pair_posterior_atleast_one(
          << "present  =" << present << endl << "previous = " << previous
          << endl;
 
-  pair_posteriors_t v(contrast.sets.size());
-  for (size_t i = 0; i < contrast.sets.size(); i++)
-    v[i] = sum_pair_posterior_atleast_one(contrast.sets[i], present, previous);
+  matrix_t keep = variant_states({0, present, previous, present | previous});
+  auto pair_posteriors = Schedule::map_sequences<pair_posterior_t>(
+      Schedule::data_sets(contrast), [&](size_t, const Data::Seq &seq) {
+        return pair_posterior_atleast_one(seq, keep);
+      });
+  pair_posteriors_t v(contrast.sets.size(), {0, 0, 0, 0, 0});
+  for (size_t i = 0; i < contrast.sets.size(); i++) {
+    for (auto &x : pair_posteriors[i])
+      v[i] += x;
+    if (verbosity >= Verbosity::verbose
+        or (verbose_conditional_mico_output and verbosity >= Verbosity::info))
+      cout << "HMM::pair_posterior_atleast_one(Data::Set = "
+           << contrast.sets[i].path << ")" << endl << "present  = " << present
+           << endl << "previous = " << previous << endl
+           << "counts: " << v[i] << endl;
+  }
 
   if (verbosity >= Verbosity::debug)
     // TODO put results into debug output
@@ -294,22 +316,16 @@ vector_t HMM::posterior_atleast_one(const Data::Set &dataset,
   }
 
   vector_t vec(dataset.set_size);
-  SubHMM subhmm(*this, complementary_states_mask(present));
-#pragma omp parallel for schedule(static) if (DO_PARALLEL)
-  for (size_t i = 0; i < dataset.set_size; i++) {
-    double logp = log_likelihood_from_scale(
-        compute_forward_scale(dataset.sequences[i]));
-    double logp_wo_motif = log_likelihood_from_scale(
-        subhmm.compute_forward_scale(dataset.sequences[i]));
-    double z = 1 - exp(logp_wo_motif - logp);
-    if (verbosity >= Verbosity::debug)
-      cout << "seq = "
-           << dataset.sequences[i].definition
-           /*  << " " << dataset.sequences[i].sequence */
-           << " logp = " << logp << " logp_wo_motif = " << logp_wo_motif
-           << " z = " << z << endl;
-    vec[i] = z;
+  auto subhmm = sub_model(present);
+  const auto &order = Schedule::by_length(dataset);
+  Schedule::Utilization::Loop loop_timer;
+#pragma omp parallel for schedule(dynamic) if (DO_PARALLEL)
+  for (size_t k = 0; k < order.size(); k++) {
+    Schedule::Utilization::Item item_timer;
+    size_t i = order[k];
+    vec[i] = posterior_atleast_one(dataset.sequences[i], *subhmm).posterior;
   }
+  Schedule::copy_to_duplicates(dataset, vec);
 
   if (verbosity >= Verbosity::debug)
     cout << "HMM::posterior_atleast_one(Data::Set = " << dataset.path << ")"
@@ -334,48 +350,17 @@ HMM::pair_posteriors_t HMM::pair_posterior_atleast_one(
   }
 
   pair_posteriors_t vec(dataset.set_size);
-  SubHMM subhmm_one(*this, complementary_states_mask(present));
-  SubHMM subhmm_two(*this, complementary_states_mask(previous));
-  SubHMM subhmm_both(*this, complementary_states_mask(present | previous));
-#pragma omp parallel for schedule(static) if (DO_PARALLEL)
-  for (size_t i = 0; i < dataset.set_size; i++) {
-    const PairPosteriorMode mode = PairPosteriorMode::Independence;
-    if (mode == PairPosteriorMode::MutualPresence) {
-      double logp = log_likelihood_from_scale(
-          compute_forward_scale(dataset.sequences[i]));
-      double logp_wo_one = log_likelihood_from_scale(
-          subhmm_one.compute_forward_scale(dataset.sequences[i]));
-      double logp_wo_two = log_likelihood_from_scale(
-          subhmm_two.compute_forward_scale(dataset.sequences[i]));
-      double logp_wo_either = log_likelihood_from_scale(
-          subhmm_both.compute_forward_scale(dataset.sequences[i]));
-      double z_one = 1 - exp(logp_wo_one - logp);
-      double z_two = 1 - exp(logp_wo_two - logp);
-      double z_either = 1 - exp(logp_wo_either - logp);
-      double z_both = z_one + z_two - z_either;
-      pair_posterior_t p = {logp, z_one, z_two, z_both, 1 - z_either};
-      if (verbosity >= Verbosity::debug)
-        cout << "seq = " << dataset.sequences[i].definition << " " << p << endl;
-      vec[i] = p;
-    } else if (mode == PairPosteriorMode::Independence) {
-      double logp = log_likelihood_from_scale(
-          compute_forward_scale(dataset.sequences[i]));
-      double logp_wo_one = log_likelihood_from_scale(
-          subhmm_one.compute_forward_scale(dataset.sequences[i]));
-      double logp_wo_two = log_likelihood_from_scale(
-          subhmm_two.compute_forward_scale(dataset.sequences[i]));
-      double logp_wo_either = log_likelihood_from_scale(
-          subhmm_both.compute_forward_scale(dataset.sequences[i]));
-      double z_one = 1 - exp(logp_wo_either - logp_wo_two);
-      double z_two = 1 - exp(logp_wo_either - logp_wo_one);
-      double z_neither = (1 - z_one) * (1 - z_two);
-      double z_both = z_one * z_two;
-      pair_posterior_t p = {logp, z_one, z_two, z_both, z_neither};
-      if (verbosity >= Verbosity::debug)
-        cout << "seq = " << dataset.sequences[i].definition << " " << p << endl;
-      vec[i] = p;
-    }
+  // the full model and the models without either or both motifs
+  matrix_t keep = variant_states({0, present, previous, present | previous});
+  const auto &order = Schedule::by_length(dataset);
+  Schedule::Utilization::Loop loop_timer;
+#pragma omp parallel for schedule(dynamic) if (DO_PARALLEL)
+  for (size_t k = 0; k < order.size(); k++) {
+    Schedule::Utilization::Item item_timer;
+    size_t i = order[k];
+    vec[i] = pair_posterior_atleast_one(dataset.sequences[i], keep);
   }
+  Schedule::copy_to_duplicates(dataset, vec);
 
   if (verbosity >= Verbosity::debug)
     cout << "HMM::pair_posterior_atleast_one(Data::Set = " << dataset.path
@@ -384,45 +369,32 @@ HMM::pair_posteriors_t HMM::pair_posterior_atleast_one(
   return vec;
 }
 
-double HMM::sum_posterior_atleast_one(const Data::Set &dataset,
-                                      bitmask_t present) const {
-  if (verbosity >= Verbosity::debug)
-    cout << "HMM::sum_posterior_atleast_one(Data::Set = " << dataset.path << ")"
-         << endl << "present = " << present << endl;
-
-  vector_t counts = posterior_atleast_one(dataset, present);
-
-  double m = 0;
-  for (auto &x : counts)
-    m += x;
-
-  if (verbosity >= Verbosity::debug)
-    cout << "HMM::sum_posterior_atleast_one(Data::Set = " << dataset.path << ")"
-         << endl << "present = " << present << endl << "m = " << m << endl;
-  return m;
-};
-
-HMM::pair_posterior_t HMM::sum_pair_posterior_atleast_one(
-    const Data::Set &dataset, bitmask_t present, bitmask_t previous) const {
+HMM::pair_posterior_t HMM::pair_posterior_atleast_one(
+    const Data::Seq &seq, const matrix_t &keep) const {
+  vector_t logps;
+  log_likelihood_batch(seq, keep, logps);
+  double logp = logps(0);
+  double logp_wo_one = logps(1);
+  double logp_wo_two = logps(2);
+  double logp_wo_either = logps(3);
+  const PairPosteriorMode mode = PairPosteriorMode::Independence;
+  pair_posterior_t p = {logp, 0, 0, 0, 0};
+  if (mode == PairPosteriorMode::MutualPresence) {
+    double z_one = 1 - exp(logp_wo_one - logp);
+    double z_two = 1 - exp(logp_wo_two - logp);
+    double z_either = 1 - exp(logp_wo_either - logp);
+    double z_both = z_one + z_two - z_either;
+    p = {logp, z_one, z_two, z_both, 1 - z_either};
+  } else if (mode == PairPosteriorMode::Independence) {
+    double z_one = 1 - exp(logp_wo_either - logp_wo_two);
+    double z_two = 1 - exp(logp_wo_either - logp_wo_one);
+    double z_neither = (1 - z_one) * (1 - z_two);
+    double z_both = z_one * z_two;
+    p = {logp, z_one, z_two, z_both, z_neither};
+  }
   if (verbosity >= Verbosity::debug)
-    cout << "HMM::sum_pair_posterior_atleast_one(Data::Set = " << dataset.path
-         << ")" << endl << "present  = " << present << endl
-         << "previous = " << previous << endl;
-
-  pair_posteriors_t pair_counts
-      = pair_posterior_atleast_one(dataset, present, previous);
-
-  pair_posterior_t summed_pair_counts = {0, 0, 0, 0, 0};
-  for (auto &x : pair_counts)
-    summed_pair_counts += x;
-
-  if (verbosity >= Verbosity::verbose
-      or (verbose_conditional_mico_output and verbosity >= Verbosity::info))
-    cout << "HMM::sum_pair_posterior_atleast_one(Data::Set = " << dataset.path
-         << ")" << endl << "present  = " << present << endl
-         << "previous = " << previous << endl
-         << "counts: " << summed_pair_counts << endl;
-  return summed_pair_counts;
+    cout << "seq = " << seq.definition << " " << p << endl;
+  return p;
 }
 
 HMM::posterior_t HMM::posterior_atleast_one(const Data::Seq &seq,
@@ -431,25 +403,50 @@ HMM::posterior_t HMM::posterior_atleast_one(const Data::Seq &seq,
     cout << "HMM::posterior_atleast_one(Data::Seq)"
          << "present = " << present << endl;
 
-  double logp = log_likelihood_from_scale(compute_forward_scale(seq));
+  posterior_t res = posterior_atleast_one(seq, *sub_model(present));
+
+  if (verbosity >= Verbosity::debug)
+    cout << "HMM::posterior_atleast_one(Data::Seq)" << endl
+         << "present = " << present << endl << "z = " << res.posterior << endl;
+  return res;
+};
 
-  double z;
-  SubHMM subhmm(*this, complementary_states_mask(present));
-  double logp_wo_motif
-      = log_likelihood_from_scale(subhmm.compute_forward_scale(seq));
+HMM::posterior_t HMM::posterior_atleast_one(const Data::Seq &seq,
+                                            const SubHMM &subhmm) const {
+  Workspace &ws = workspace();
+  ws.reserve(0, n_states);
+  vector_t &prev = ws.prev, &prev_r = ws.prev_r;
+  vector_t &cur = ws.cur, &cur_r = ws.cur_r;
+  fill_n(prev.begin(), n_states, 0.0);
+  fill_n(prev_r.begin(), n_states, 0.0);
+  prev(start_state) = prev_r(start_state) = 1;
+
+  // the scaling factors are accumulated in log space as they are computed;
+  // the final transition to the start state is like that for an empty symbol
+  size_t T = seq.size();
+  double logp = 0, logp_wo_motif = 0;
+  for (size_t t = 0; t <= T; t++) {
+    size_t symbol = t < T ? seq.symbol(t) : empty_symbol;
+    double scale, scale_r;
+    forward_step_pair(symbol, subhmm.reduce, &prev(0), &prev_r(0), &cur(0),
+                      &cur_r(0), scale, scale_r);
+    logp += log(scale);
+    logp_wo_motif += log(scale_r);
+    scale_forward_step(symbol, scale, &cur(0));
+    scale_forward_step(symbol, scale_r, &cur_r(0));
+    prev.swap(cur);
+    prev_r.swap(cur_r);
+  }
 
-  z = 1 - exp(logp_wo_motif - logp);
+  double z = 1 - exp(logp_wo_motif - logp);
   if (verbosity >= Verbosity::debug)
     cout << "seq = " << seq.definition << " " << seq.sequence
          << " logp = " << logp << " logp_wo_motif = " << logp_wo_motif
          << " z = " << z << endl;
 
-  if (verbosity >= Verbosity::debug)
-    cout << "HMM::posterior_atleast_one(Data::Seq)" << endl
-         << "present = " << present << endl << "z = " << z << endl;
   posterior_t res = {logp, z};
   return res;
-};
+}
 
 double HMM::compute_score_all_motifs(
     const Data::Collection &collection,
@@ -564,44 +561,39 @@ double HMM::compute_score(const Data::Collection &collection,
 
 double HMM::class_likelihood(const Data::Contrast &contrast, bitmask_t present,
                              bool compute_posterior) const {
-  double l = 0;
-  for (auto &dataset : contrast)
-    l += class_likelihood(dataset, present, compute_posterior);
-  if (verbosity >= Verbosity::debug)
-    cout << "Data::Contrast l = " << l << endl;
-  return l;
-}
-
-double HMM::class_likelihood(const Data::Set &dataset, bitmask_t present,
-                             bool compute_posterior) const {
   // TODO FIX BITMASK MMIE
   const double marginal_motif_prior
       = registration.compute_marginal_motif_prior(present);
-  // const double marginal_motif_prior  = 0.5;
-  // TODO FIX BITMASK MMIE
-  const double class_cond
-      = registration.get_class_motif_prior(dataset.sha1, present);
-  // const double class_cond = 0.2;
-  const double log_class_prior
-      = log(registration.get_class_prior(dataset.sha1));
-
+  auto subhmm = sub_model(present);
+  auto posteriors = Schedule::map_sequences<posterior_t>(
+      Schedule::data_sets(contrast), [&](size_t, const Data::Seq &seq) {
+        return posterior_atleast_one(seq, *subhmm);
+      });
   double l = 0;
-#pragma omp parallel for schedule(static) reduction(+ : l) if (DO_PARALLEL)
-  for (size_t i = 0; i < dataset.set_size; i++) {
-    posterior_t res = posterior_atleast_one(dataset.sequences[i], present);
-    double p = res.posterior;
-    double x = log_class_prior
-               + log(p * class_cond / marginal_motif_prior
-                     + (1 - p) * (1 - class_cond) / (1 - marginal_motif_prior));
-    if (not compute_posterior)
-      x += res.log_likelihood;
-    if (verbosity >= Verbosity::debug)
-      cout << "Sequence " << dataset.sequences[i].definition << " p = " << p
-           << " class log likelihood = " << x << " exp -> " << exp(x) << endl;
-    l += x;
+  for (size_t set_idx = 0; set_idx < contrast.sets.size(); set_idx++) {
+    const Data::Set &dataset = contrast.sets[set_idx];
+    const double class_cond
+        = registration.get_class_motif_prior(dataset.sha1, present);
+    const double log_class_prior
+        = log(registration.get_class_prior(dataset.sha1));
+    for (size_t i = 0; i < dataset.set_size; i++) {
+      const posterior_t &res = posteriors[set_idx][i];
+      double p = res.posterior;
+      double x = log_class_prior
+                 + log(p * class_cond / marginal_motif_prior
+                       + (1 - p) * (1 - class_cond)
+                         / (1 - marginal_motif_prior));
+      if (not compute_posterior)
+        x += res.log_likelihood;
+      if (verbosity >= Verbosity::debug)
+        cout << "Sequence " << dataset.sequences[i].definition << " p = " << p
+             << " class log likelihood = " << x << " exp -> " << exp(x)
+             << endl;
+      l += x;
+    }
   }
   if (verbosity >= Verbosity::debug)
-    cout << "Data::Set " << dataset.path << " l = " << l << endl;
+    cout << "Data::Contrast l = " << l << endl;
   return l;
 }
 
@@ -616,9 +608,10 @@ bool HMM::is_present(const Data::Set &dataset, bitmask_t present) const {
 double HMM::log_likelihood_difference(const Data::Contrast &contrast,
                                       bitmask_t present) const {
   double d = 0;
+  auto l = log_likelihoods(Schedule::data_sets(contrast));
   for (size_t sample_idx = 0; sample_idx < contrast.sets.size(); sample_idx++) {
     bool signal = is_present(contrast.sets[sample_idx], present);
-    d += (signal ? 1 : -1) * log_likelihood(contrast.sets[sample_idx]);
+    d += (signal ? 1 : -1) * l[sample_idx];
   }
   return d;
 }
@@ -44,6 +44,7 @@
 #include <git_config.hpp>
 #include <discrover_paths.hpp>
 #include "cli.hpp"
+#include "schedule.hpp"
 
 using namespace std;
 
@@ -495,6 +496,7 @@ int main(int argc, const char **argv) {
   rng.seed(options.random_salt);
 
   Fasta::EntropySource::seed(RandomDistribution::Uniform(rng));
+  Fasta::Cache::directory = options.cache_directory;
   MCMC::EntropySource::seed(RandomDistribution::Uniform(rng));
 
   // main routine
@@ -505,6 +507,9 @@ int main(int argc, const char **argv) {
     return EXIT_FAILURE;
   }
 
+  if (options.timing_information)
+    Schedule::Utilization::report(cerr);
+
   if (options.verbosity >= Verbosity::info) {
     struct rusage usage;
     if (getrusage(RUSAGE_SELF, &usage) != 0) {
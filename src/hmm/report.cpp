@@ -3,6 +3,7 @@
 #include <fstream>
 #include <vector>
 #include <numeric>
+#include <algorithm>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/filter/bzip2.hpp>
@@ -24,6 +25,8 @@
 
 using namespace std;
 
+#define DO_PARALLEL 1
+
 #if CAIRO_FOUND
 #include "../logo/logo.hpp"
 #endif
@@ -263,18 +266,26 @@ void correlation_report(const vector<T> &x, ostream &out, size_t width = 12,
   out.flags(flags);
 }
 
-void Evaluator::print_posterior(ostream &os, const vector_t &scale,
-                                const matrix_t &f, const matrix_t &b) const {
-  const size_t n = scale.size() - 2;
-  vector_t posterior(n);
+void Evaluator::print_posterior(ostream &os, const Data::Seq &seq) const {
+  const size_t n = seq.size();
+  vector<size_t> motif_groups, states;
   for (size_t group_idx = 0; group_idx < hmm.get_ngroups(); group_idx++)
     if (hmm.is_motif_group(group_idx)) {
-      size_t k = *begin(hmm.groups[group_idx].states);
-      os << "Posterior (" << hmm.get_group_name(group_idx) << ")";
-      for (size_t i = 1; i <= n; ++i)
-        os << " " << f(i, k) * b(i, k) * scale(i);
-      os << endl;
+      motif_groups.push_back(group_idx);
+      states.push_back(*begin(hmm.groups[group_idx].states));
     }
+  vector<vector<double>> posterior(states.size(), vector<double>(n));
+  hmm.state_posteriors(seq, states, [&](size_t i, const double *p) {
+    if (i >= 1 and i <= n)
+      for (size_t j = 0; j < states.size(); j++)
+        posterior[j][i - 1] = p[j];
+  });
+  for (size_t j = 0; j < states.size(); j++) {
+    os << "Posterior (" << hmm.get_group_name(motif_groups[j]) << ")";
+    for (auto x : posterior[j])
+      os << " " << x;
+    os << endl;
+  }
 }
 
 Evaluator::ResultsCounts Evaluator::evaluate_dataset(
@@ -332,79 +343,134 @@ Evaluator::ResultsCounts Evaluator::evaluate_dataset(
         out << "RIC = " << ric << endl;
       }
 
-  for (size_t i = 0; i < dataset.sequences.size(); i++) {
-    HMM::StatePath viterbi_path;
-    // TODO EVALUATION
-    double lp = hmm.viterbi(dataset.sequences[i], viterbi_path);
-
-    if (not(options.evaluate.skip_viterbi_path
-            and options.evaluate.skip_summary
-            and options.evaluate.skip_bed)) {
-      stringstream viterbi_str, exp_str, atl_str;
-
-      bool first = true;
-      size_t motif_idx = 0;
-      for (size_t group_idx = 0; group_idx < n_groups; group_idx++)
-        if (hmm.is_motif_group(group_idx)) {
-          if (first)
-            first = false;
-          else {
-            viterbi_str << "/";
-            exp_str << "/";
-            atl_str << "/";
-          }
+  const bool per_motif_statistics
+      = not(options.evaluate.skip_viterbi_path
+            and options.evaluate.skip_summary and options.evaluate.skip_bed);
+  vector<size_t> motif_groups;
+  for (size_t group_idx = 0; group_idx < n_groups; group_idx++)
+    if (hmm.is_motif_group(group_idx))
+      motif_groups.push_back(group_idx);
+  // the full model and the models without each one of the motifs, whose
+  // likelihoods are computed together in one forward sweep; and the first
+  // state of each motif, which is assumed to be constitutive for the motif
+  vector<bitmask_t> absent = {0};
+  vector<size_t> motif_states;
+  for (auto group_idx : motif_groups) {
+    absent.push_back(1 << group_idx);
+    motif_states.push_back(hmm.groups[group_idx].states[0]);
+  }
+  const matrix_t keep = hmm.variant_states(absent);
+
+  // Blocks of sequences are decoded in parallel, longest first, and then
+  // written out in their original order. Sequences identical to an earlier
+  // one of the same block take over its results.
+  const size_t block_size = 1024;
+  vector<HMM::StatePath> viterbi_paths(min(n, block_size));
+  vector<double> viterbi_lps(min(n, block_size));
+  for (size_t block = 0; block < n; block += block_size) {
+    const size_t block_end = min(n, block + block_size);
+    vector<size_t> order, duplicates;
+    for (size_t i = block; i < block_end; i++)
+      if (dataset.representative[i] == i or dataset.representative[i] < block)
+        order.push_back(i);
+      else
+        duplicates.push_back(i);
+    stable_sort(begin(order), end(order), [&](size_t a, size_t b) {
+      return dataset.sequences[a].size()
+             > dataset.sequences[b].size();
+    });
+
+    Schedule::Utilization::Loop loop_timer;
+#pragma omp parallel for schedule(dynamic) if (DO_PARALLEL)
+    for (size_t k = 0; k < order.size(); k++) {
+      Schedule::Utilization::Item item_timer;
+      size_t i = order[k];
+      viterbi_lps[i - block]
+          = hmm.viterbi(dataset.sequences[i], viterbi_paths[i - block]);
+      if (per_motif_statistics) {
+        vector_t logps;
+        hmm.log_likelihood_batch(dataset.sequences[i], keep, logps);
+        auto expected = hmm.expected_state_posteriors(dataset.sequences[i],
+                                                      motif_states);
+        for (size_t motif_idx = 0; motif_idx < motif_groups.size();
+             motif_idx++) {
+          atl_counts[motif_idx][i] = 1 - exp(logps(motif_idx + 1) - logps(0));
+          exp_counts[motif_idx][i] = expected[motif_idx];
+        }
+      }
+    }
+    for (auto i : duplicates) {
+      size_t j = dataset.representative[i];
+      viterbi_lps[i - block] = viterbi_lps[j - block];
+      viterbi_paths[i - block] = viterbi_paths[j - block];
+      if (per_motif_statistics)
+        for (size_t motif_idx = 0; motif_idx < motif_groups.size();
+             motif_idx++) {
+          atl_counts[motif_idx][i] = atl_counts[motif_idx][j];
+          exp_counts[motif_idx][i] = exp_counts[motif_idx][j];
+        }
+    }
 
-          bitmask_t present_mask = 1 << group_idx;
-          // TODO EVALUATION
-          double atl = hmm.posterior_atleast_one(dataset.sequences[i],
-                                                 present_mask).posterior;
-          // TODO EVALUATION
-          double expected
-              = hmm.expected_posterior(dataset.sequences[i], present_mask);
-          size_t n_viterbi = hmm.count_motif(viterbi_path, group_idx);
-          atl_counts[motif_idx][i] = atl;
-          exp_counts[motif_idx][i] = expected;
-          vit_counts[motif_idx][i] = n_viterbi;
-
-          n_sites[group_idx] += atl;
-          n_motifs[group_idx] += expected;
-          n_viterbi_sites[group_idx] += (n_viterbi > 0 ? 1 : 0);
-          n_viterbi_motifs[group_idx] += n_viterbi;
-
-          if (not options.evaluate.skip_viterbi_path) {
-            viterbi_str << n_viterbi;
-            exp_str << expected;
-            atl_str << atl;
-          }
+    for (size_t i = block; i < block_end; i++) {
+      const HMM::StatePath &viterbi_path = viterbi_paths[i - block];
+      double lp = viterbi_lps[i - block];
+
+      if (per_motif_statistics) {
+        stringstream viterbi_str, exp_str, atl_str;
+
+        bool first = true;
+        size_t motif_idx = 0;
+        for (size_t group_idx = 0; group_idx < n_groups; group_idx++)
+          if (hmm.is_motif_group(group_idx)) {
+            if (first)
+              first = false;
+            else {
+              viterbi_str << "/";
+              exp_str << "/";
+              atl_str << "/";
+            }
+
+            double atl = atl_counts[motif_idx][i];
+            double expected = exp_counts[motif_idx][i];
+            size_t n_viterbi = hmm.count_motif(viterbi_path, group_idx);
+            vit_counts[motif_idx][i] = n_viterbi;
 
-          motif_idx++;
+            n_sites[group_idx] += atl;
+            n_motifs[group_idx] += expected;
+            n_viterbi_sites[group_idx] += (n_viterbi > 0 ? 1 : 0);
+            n_viterbi_motifs[group_idx] += n_viterbi;
+
+            if (not options.evaluate.skip_viterbi_path) {
+              viterbi_str << n_viterbi;
+              exp_str << expected;
+              atl_str << atl;
+            }
+
+            motif_idx++;
+          }
+        if (not options.evaluate.skip_viterbi_path) {
+          v_out << ">" << dataset.sequences[i].definition << endl;
+          v_out << "V-sites = " << viterbi_str.str()
+                << " E-sites = " << exp_str.str()
+                << " P(#sites>=1) = " << atl_str.str()
+                << " Viterbi log-p = " << lp << endl;
+          v_out << dataset.sequences[i].strands() << endl;
+          v_out << hmm.path2string_group(viterbi_path) << endl;
         }
-      if (not options.evaluate.skip_viterbi_path) {
-        v_out << ">" << dataset.sequences[i].definition << endl;
-        v_out << "V-sites = " << viterbi_str.str()
-              << " E-sites = " << exp_str.str()
-              << " P(#sites>=1) = " << atl_str.str()
-              << " Viterbi log-p = " << lp << endl;
-        v_out << dataset.sequences[i].sequence << endl;
-        v_out << hmm.path2string_group(viterbi_path) << endl;
-      }
 
-      if (options.evaluate.print_posterior) {
-        vector_t scale;
-        auto f = hmm.compute_forward_scaled(dataset.sequences[i], scale);
-        auto b = hmm.compute_backward_prescaled(dataset.sequences[i], scale);
-        print_posterior(v_out, scale, f, b);
+        if (options.evaluate.print_posterior)
+          print_posterior(v_out, dataset.sequences[i]);
+        if (options.evaluate.conditional_motif_probability)
+          conditional_decoder.decode(v_out, dataset.sequences[i]);
       }
-      if (options.evaluate.conditional_motif_probability)
-        conditional_decoder.decode(v_out, dataset.sequences[i]);
-    }
 
-    if (not options.evaluate.skip_bed)
-      hmm.print_occurrence_table(dataset.name(), dataset.sequences[i],
-                                 viterbi_path, bed_out, true);
-    if (not options.evaluate.skip_occurrence_table)
-      hmm.print_occurrence_table(dataset.name(), dataset.sequences[i],
-                                 viterbi_path, occ_out, false);
+      if (not options.evaluate.skip_bed)
+        hmm.print_occurrence_table(dataset.name(), dataset.sequences[i],
+                                   viterbi_path, bed_out, true);
+      if (not options.evaluate.skip_occurrence_table)
+        hmm.print_occurrence_table(dataset.name(), dataset.sequences[i],
+                                   viterbi_path, occ_out, false);
+    }
   }
 
   if (not options.evaluate.skip_summary) {
@@ -55,8 +55,7 @@ public:
                 const Options::HMM &options) const;
 
 private:
-  void print_posterior(std::ostream &os, const vector_t &scale,
-                       const matrix_t &f, const matrix_t &b) const;
+  void print_posterior(std::ostream &os, const Data::Seq &seq) const;
   void eval_contrast(std::ostream &ofs, const Data::Contrast &contrast,
                      bool limit_logp, const std::string &tag) const;
 
@@ -14,7 +14,7 @@
 #include "results.hpp"
 
 namespace Training {
-State::State(size_t n) : center(-9), scores(n){};
+State::State(size_t n) : center(0), scores(n){};
 
 Result::Result() : state(), delta(0), parameter_file(""){};
 }
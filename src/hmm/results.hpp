@@ -38,7 +38,7 @@ namespace Training {
 
 struct State {
   State(size_t n = 0);
-  int center;
+  int center;  // log2 of the step length last chosen in line searching
   std::vector<std::vector<double>> scores;
 };
 
@@ -0,0 +1,86 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  schedule.cpp
+ *
+ *    Description:  Processing order and thread utilization of loops over
+ *                  sequences
+ *
+ * =====================================================================================
+ */
+
+#include <omp.h>
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+#include "schedule.hpp"
+
+using namespace std;
+
+namespace Schedule {
+const vector<size_t> &by_length(const Data::Set &dataset) {
+  return dataset.by_length;
+}
+
+Sets data_sets(const Data::Contrast &contrast) {
+  Sets sets;
+  for (auto &dataset : contrast)
+    sets.push_back(&dataset);
+  return sets;
+}
+
+Sets data_sets(const Data::Collection &collection) {
+  Sets sets;
+  for (auto &contrast : collection)
+    for (auto &dataset : contrast)
+      sets.push_back(&dataset);
+  return sets;
+}
+
+vector<Task> by_length(const Sets &sets) {
+  vector<Task> tasks;
+  for (size_t set_idx = 0; set_idx < sets.size(); set_idx++)
+    for (auto seq_idx : sets[set_idx]->by_length)
+      tasks.push_back({set_idx, seq_idx});
+  auto length = [&](const Task &task) {
+    return sets[task.set]->sequences[task.seq].size();
+  };
+  stable_sort(begin(tasks), end(tasks), [&](const Task &a, const Task &b) {
+    return length(a) > length(b);
+  });
+  return tasks;
+}
+
+namespace Utilization {
+/** Busy time of each thread, and total wall time of the loops, in µs */
+static vector<double> busy;
+static double wall = 0;
+
+Loop::Loop() : timer() {
+  if (not omp_in_parallel() and busy.size() < size_t(omp_get_max_threads()))
+    busy.resize(omp_get_max_threads(), 0);
+}
+
+Loop::~Loop() {
+  if (not omp_in_parallel())
+    wall += timer.tock();
+}
+
+Item::~Item() {
+  // only count the outermost loop; nested ones are part of its items
+  size_t idx = omp_get_thread_num();
+  if (omp_get_level() == 1 and idx < busy.size())
+    busy[idx] += timer.tock();
+}
+
+void report(ostream &os) {
+  if (wall == 0)
+    return;
+  os << "Thread utilization in loops over sequences:";
+  for (size_t i = 0; i < busy.size(); i++)
+    os << " " << i << ": " << fixed << setprecision(1)
+       << 100 * busy[i] / wall << "%";
+  os << defaultfloat << endl;
+}
+}
+}
@@ -0,0 +1,110 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  schedule.hpp
+ *
+ *    Description:  Processing order and thread utilization of loops over
+ *                  sequences
+ *
+ * =====================================================================================
+ */
+
+#ifndef SCHEDULE_HPP
+#define SCHEDULE_HPP
+
+#include <ostream>
+#include <vector>
+#include "../timer.hpp"
+#include "basedefs.hpp"
+
+namespace Schedule {
+/** Indices of the distinct sequences, longest first.
+ *
+ * Loops over sequences iterate in this order with dynamic scheduling: the
+ * long sequences are started first, and idle threads take the short ones
+ * that remain, so that all threads finish at about the same time.
+ *
+ * Identical sequences are only visited once; sums over sequences weight the
+ * visited ones with dataset.multiplicity, and per-sequence values are copied
+ * to the duplicates with copy_to_duplicates(). */
+const std::vector<size_t> &by_length(const Data::Set &dataset);
+
+/** Assign the value of each visited sequence to the sequences identical to
+ * it */
+template <typename V>
+void copy_to_duplicates(const Data::Set &dataset, V &values) {
+  for (size_t i = 0; i < dataset.representative.size(); i++)
+    if (dataset.representative[i] != i)
+      values[i] = values[dataset.representative[i]];
+}
+
+/** A list of data sets whose sequences are processed in a single loop, rather
+ * than in one parallel region per data set */
+using Sets = std::vector<const Data::Set *>;
+/** The data sets of a contrast */
+Sets data_sets(const Data::Contrast &contrast);
+/** The data sets of all contrasts of a collection */
+Sets data_sets(const Data::Collection &collection);
+
+/** A sequence of one of several data sets */
+struct Task {
+  size_t set;  // index into the list of data sets
+  size_t seq;  // index of the sequence in its data set
+};
+/** The distinct sequences of several data sets, longest first */
+std::vector<Task> by_length(const Sets &sets);
+
+/** Evaluate fnc(set_idx, seq) for every distinct sequence of the data sets in
+ * a single parallel loop, longest first, and return the values by data set
+ * and sequence, including duplicates. Summing these in order gives results
+ * that do not depend on the number of threads. */
+template <typename T, typename Fnc>
+std::vector<std::vector<T>> map_sequences(const Sets &sets, Fnc fnc);
+
+/** Per-thread utilization of the sequence-parallel loops, reported with
+ * --time. */
+namespace Utilization {
+/** Measures the wall time of a parallel loop; to be constructed by the
+ * master thread before the loop. */
+class Loop {
+public:
+  Loop();
+  ~Loop();
+
+private:
+  Timer timer;
+};
+/** Measures the time a thread spends on one sequence; to be constructed at
+ * the beginning of the loop body. */
+class Item {
+public:
+  ~Item();
+
+private:
+  Timer timer;
+};
+/** Write the fraction of the loops' wall time that each thread was busy */
+void report(std::ostream &os);
+}
+
+template <typename T, typename Fnc>
+std::vector<std::vector<T>> map_sequences(const Sets &sets, Fnc fnc) {
+  std::vector<std::vector<T>> values;
+  for (auto dataset : sets)
+    values.push_back(std::vector<T>(dataset->sequences.size()));
+  const auto tasks = by_length(sets);
+  Utilization::Loop loop_timer;
+#pragma omp parallel for schedule(dynamic)
+  for (size_t k = 0; k < tasks.size(); k++) {
+    Utilization::Item item_timer;
+    const Task &task = tasks[k];
+    values[task.set][task.seq]
+        = fnc(task.set, sets[task.set]->sequences[task.seq]);
+  }
+  for (size_t set_idx = 0; set_idx < sets.size(); set_idx++)
+    copy_to_duplicates(*sets[set_idx], values[set_idx]);
+  return values;
+}
+}
+
+#endif
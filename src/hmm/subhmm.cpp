@@ -17,6 +17,7 @@ SubHMM::SubHMM(const HMM &hmm, const Training::Range &states)
     if (find(lift.begin(), lift.end(), i) == lift.end())
       del_column(i);
   initialize_pred_succ();
+  compile_emissions();
   if (verbosity >= Verbosity::debug)
     cout << "Constructed SubHMM" << endl;
 }
@@ -36,17 +37,27 @@ Training::Targets SubHMM::map_down(const Training::Targets &targets) const {
 }
 
 matrix_t SubHMM::lift_emission(const matrix_t &m) const {
-  matrix_t n = zero_matrix(n_original_states, n_emissions);
+  matrix_t n;
+  lift_emission(m, n);
+  return n;
+}
+
+matrix_t SubHMM::lift_transition(const matrix_t &m) const {
+  matrix_t n;
+  lift_transition(m, n);
+  return n;
+}
+
+void SubHMM::lift_emission(const matrix_t &m, matrix_t &n) const {
+  Workspace::reset(n, n_original_states, n_emissions);
   for (size_t i = 0; i < m.size1(); i++)
     for (size_t j = 0; j < m.size2(); j++)
       n(lift[i], j) = m(i, j);
-  return n;
 }
 
-matrix_t SubHMM::lift_transition(const matrix_t &m) const {
-  matrix_t n = zero_matrix(n_original_states, n_original_states);
+void SubHMM::lift_transition(const matrix_t &m, matrix_t &n) const {
+  Workspace::reset(n, n_original_states, n_original_states);
   for (size_t i = 0; i < m.size1(); i++)
     for (size_t j = 0; j < m.size2(); j++)
       n(lift[i], lift[j]) = m(i, j);
-  return n;
 }
@@ -44,6 +44,8 @@ public:
   Training::Targets map_down(const Training::Targets &targets) const;
   matrix_t lift_emission(const matrix_t &m) const;
   matrix_t lift_transition(const matrix_t &m) const;
+  void lift_emission(const matrix_t &m, matrix_t &n) const;
+  void lift_transition(const matrix_t &m, matrix_t &n) const;
   // std::vector<size_t> reduce(const std::vector<size_t> &v) const;
   // std::vector<size_t> lift(const std::vector<size_t> &v) const;
 };
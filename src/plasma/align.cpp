@@ -17,20 +17,33 @@ using namespace std;
 
 const char TERMINATOR_SYMBOL = '$';
 
+size_t collapsed_size(const Seeding::Collection &collection) {
+  size_t n = 0;
+  for (auto &contrast : collection)
+    for (auto &dataset : contrast)
+      for (auto &seq : dataset)
+        n += seq.sequence.size() + 1;
+  return n;
+}
+
+template <class idx_t>
 vector<symbol_t> collapse_collection(const Seeding::Collection &collection,
-                                     vector<size_t> &pos2seq,
+                                     vector<idx_t> &pos2seq,
                                      vector<size_t> &seq2set,
                                      vector<size_t> &set2contrast,
                                      bool allow_iupac_wildcards) {
+  const size_t n = collapsed_size(collection);
   vector<symbol_t> s;
+  s.reserve(n);
+  pos2seq.reserve(n);
   size_t seq_idx = 0;
   size_t set_idx = 0;
   size_t contrast_idx = 0;
   for (auto &contrast : collection) {
     for (auto &dataset : contrast) {
       for (auto &seq : dataset) {
-        add_sequence(s, seq.sequence + TERMINATOR_SYMBOL,
-                     allow_iupac_wildcards);
+        add_sequence(s, seq.sequence, allow_iupac_wildcards);
+        add_sequence(s, string(1, TERMINATOR_SYMBOL), allow_iupac_wildcards);
         for (size_t i = 0; i < seq.sequence.size() + 1; i++)
           pos2seq.push_back(seq_idx);
         seq2set.push_back(set_idx);
@@ -43,3 +56,54 @@ vector<symbol_t> collapse_collection(const Seeding::Collection &collection,
   }
   return s;
 }
+
+template vector<symbol_t> collapse_collection(
+    const Seeding::Collection &collection, vector<uint32_t> &pos2seq,
+    vector<size_t> &seq2set, vector<size_t> &set2contrast,
+    bool allow_iupac_wildcards);
+template vector<symbol_t> collapse_collection(
+    const Seeding::Collection &collection, vector<size_t> &pos2seq,
+    vector<size_t> &seq2set, vector<size_t> &set2contrast,
+    bool allow_iupac_wildcards);
+
+CompactNucleotideIndex::CompactNucleotideIndex(Verbosity verbosity)
+    : compact(true), index32(verbosity), index64(verbosity){};
+
+CompactNucleotideIndex::CompactNucleotideIndex(
+    const Seeding::Collection &collection, bool allow_iupac_wildcards,
+    Verbosity verbosity)
+    : compact(collapsed_size(collection) + 3
+              <= numeric_limits<uint32_t>::max()),
+      index32(verbosity),
+      index64(verbosity) {
+  if (compact)
+    index32 = NucleotideIndex<uint32_t, uint8_t>(
+        collection, allow_iupac_wildcards, verbosity);
+  else
+    index64 = NucleotideIndex<size_t, uint8_t>(
+        collection, allow_iupac_wildcards, verbosity);
+}
+
+vector<size_t> CompactNucleotideIndex::word_hits_by_file(const seq_type &query,
+                                                         bool revcomp) const {
+  if (compact)
+    return index32.word_hits_by_file(query, revcomp);
+  else
+    return index64.word_hits_by_file(query, revcomp);
+}
+
+bool CompactNucleotideIndex::update(const Seeding::Collection &collection,
+                                    bool allow_iupac_wildcards) {
+  if (compact)
+    return index32.update(collection, allow_iupac_wildcards);
+  else
+    return index64.update(collection, allow_iupac_wildcards);
+}
+
+vector<size_t> CompactNucleotideIndex::seq_hits_by_file(const seq_type &query,
+                                                        bool revcomp) const {
+  if (compact)
+    return index32.seq_hits_by_file(query, revcomp);
+  else
+    return index64.seq_hits_by_file(query, revcomp);
+}
@@ -31,8 +31,14 @@
 #define ALIGN_HPP
 
 #include <iostream>
+#include <fstream>
+#include <cstdint>
 #include <cstring>
+#include <stdexcept>
 #include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include "../sha1.hpp"
 #include "suffix.hpp"
 #include "align.hpp"
 #include "code.hpp"
@@ -43,32 +49,134 @@ bool binary_and_not_null(T a, T b) {
   return (a & b) != 0;
 }
 
+/** Suffix array based index. LCP values are capped at the maximum of lcp_t,
+ * which limits the length of queries; see match().
+ *
+ * If a cache directory is given, the suffix array, LCP, and JMP tables are
+ * loaded from there if they have been saved before for the same data, and
+ * saved there otherwise. The cache files are named by the SHA1 of the data. */
 template <class data_t, class idx_t = size_t, class lcp_t = size_t,
           bool shift = false>
 class Index {
 public:
-  Index(const data_t &x, Verbosity verbosity)
-      : data(x),
-        // generate suffix array, LCP, and JMP tables
-        sa(gen_suffix_array<shift, idx_t>(begin(data), end(data), verbosity)),
-        lcp(gen_lcp<lcp_t>(begin(data), end(data), sa, verbosity)),
-        jmp(gen_jmp<idx_t>(lcp, verbosity)){};
+  Index(data_t x, Verbosity verbosity, const std::string &cache_dir = "")
+      : data(std::move(x)), sa(), lcp(), jmp() {
+    std::string path;
+    if (not cache_dir.empty() and not data.empty()) {
+      path = cache_path(cache_dir);
+      if (load(path)) {
+        if (verbosity >= Verbosity::verbose)
+          std::cerr << "Loaded index from " << path << std::endl;
+        return;
+      }
+    }
+    // generate suffix array, LCP, and JMP tables
+    sa = gen_suffix_array<shift, idx_t>(begin(data), end(data), verbosity);
+    lcp = gen_lcp<lcp_t>(begin(data), end(data), sa, verbosity);
+    jmp = gen_jmp<idx_t>(lcp, verbosity);
+    if (not path.empty())
+      save(path);
+  };
 
   template <class Cmp = std::equal_to<typename data_t::value_type>>
   std::vector<idx_t> find_matches(const data_t &query, Cmp cmp = Cmp()) const {
+    if (query.size() >= std::numeric_limits<lcp_t>::max())
+      throw std::length_error("Query too long for the LCP table of the index.");
     return match(begin(query), end(query), begin(data), end(data), sa, lcp, jmp,
                  cmp);
   };
 
+  const data_t &text() const { return data; };
+
 private:
   data_t data;             // the original data
   std::vector<idx_t> sa;   // suffix array
   std::vector<lcp_t> lcp;  // LCP table
   std::vector<idx_t> jmp;  // JMP table
+
+  static const char *magic() { return "discrover suffix index 1\n"; };
+
+  std::string cache_path(const std::string &cache_dir) const {
+    sha1::Context context;
+    context.update(data.data(),
+                   data.size() * sizeof(typename data_t::value_type));
+    boost::filesystem::path path(cache_dir);
+    path /= context.hexdigest() + "_i" + std::to_string(sizeof(idx_t)) + "_l"
+            + std::to_string(sizeof(lcp_t)) + (shift ? "_s" : "") + ".index";
+    return path.string();
+  };
+
+  /** Load the tables; returns false if the file is missing or does not fit
+   * the data */
+  bool load(const std::string &path) {
+    if (not boost::filesystem::exists(path))
+      return false;
+    try {
+      boost::iostreams::mapped_file_source file(path);
+      const size_t n = data.size(), magic_size = strlen(magic());
+      if (file.size() != magic_size + sizeof(uint64_t)
+                         + n * (2 * sizeof(idx_t) + sizeof(lcp_t))
+          or memcmp(file.data(), magic(), magic_size) != 0)
+        return false;
+      const char *pos = file.data() + magic_size;
+      uint64_t n_stored;
+      memcpy(&n_stored, pos, sizeof(uint64_t));
+      pos += sizeof(uint64_t);
+      if (n_stored != n)
+        return false;
+      sa.resize(n);
+      lcp.resize(n);
+      jmp.resize(n);
+      memcpy(sa.data(), pos, n * sizeof(idx_t));
+      pos += n * sizeof(idx_t);
+      memcpy(lcp.data(), pos, n * sizeof(lcp_t));
+      pos += n * sizeof(lcp_t);
+      memcpy(jmp.data(), pos, n * sizeof(idx_t));
+      return true;
+    } catch (std::exception &e) {
+      sa.clear();
+      lcp.clear();
+      jmp.clear();
+      return false;
+    }
+  };
+
+  /** Save the tables, writing to a temporary file that is then renamed, so
+   * that concurrent runs never see partially written files */
+  void save(const std::string &path) const {
+    namespace fs = boost::filesystem;
+    boost::system::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    fs::path tmp = fs::unique_path(path + ".%%%%-%%%%-%%%%", ec);
+    if (not ec) {
+      std::ofstream os(tmp.string(), std::ios_base::binary);
+      const uint64_t n = data.size();
+      os.write(magic(), strlen(magic()));
+      os.write(reinterpret_cast<const char *>(&n), sizeof(uint64_t));
+      os.write(reinterpret_cast<const char *>(sa.data()), n * sizeof(idx_t));
+      os.write(reinterpret_cast<const char *>(lcp.data()), n * sizeof(lcp_t));
+      os.write(reinterpret_cast<const char *>(jmp.data()), n * sizeof(idx_t));
+      os.close();
+      if (os)
+        fs::rename(tmp, path, ec);
+      else
+        ec = boost::system::errc::make_error_code(
+            boost::system::errc::io_error);
+    }
+    if (ec) {
+      fs::remove(tmp, ec);
+      std::cout << "Warning: could not write index cache file " << path << "."
+                << std::endl;
+    }
+  };
 };
 
+/** Number of symbols of the concatenation of the sequences of a collection */
+size_t collapsed_size(const Seeding::Collection &collection);
+
+template <class idx_t>
 seq_type collapse_collection(const Seeding::Collection &collection,
-                             std::vector<size_t> &pos2seq,
+                             std::vector<idx_t> &pos2seq,
                              std::vector<size_t> &seq2set,
                              std::vector<size_t> &set2contrast,
                              bool allow_iupac_wildcards);
@@ -79,15 +187,13 @@ class NucleotideIndex {
 public:
   using base_type = base_t;
 
-  NucleotideIndex(const NucleotideIndex &i)
-      : paths(i.paths),
-        pos2seq(i.pos2seq),
-        seq2set(i.seq2set),
-        set2contrast(i.set2contrast),
-        index(i.index){};
-
   NucleotideIndex(Verbosity verbosity = Verbosity::info)
-      : paths(), pos2seq(), seq2set(), set2contrast(), index({}, verbosity){};
+      : paths(),
+        pos2seq(),
+        seq2set(),
+        set2contrast(),
+        index({}, verbosity),
+        masked(){};
 
   NucleotideIndex(const Seeding::Collection &collection,
                   bool allow_iupac_wildcards, Verbosity verbosity)
@@ -97,16 +203,83 @@ public:
         set2contrast(),
         index(collapse_collection(collection, pos2seq, seq2set, set2contrast,
                                   allow_iupac_wildcards),
-              verbosity) {
+              verbosity, Fasta::Cache::directory),
+        masked() {
     for (auto &contrast : collection)
       for (auto &dataset : contrast)
         paths.push_back(dataset.path);
   };
 
+  /** Bring the index up to date with the collection it was built from, after
+   * sequences have been removed from it or positions have been masked in it.
+   * Instead of rebuilding the index, the positions of removed sequences and
+   * masked positions are marked, and occurrences overlapping them are skipped
+   * by subsequent queries. Without IUPAC wildcards, the mask symbol 'n' has
+   * code 0 and matches nothing, so the results are the same as those of a
+   * rebuilt index. With IUPAC wildcards, 'n' has code 15 and matches every
+   * nucleotide, so updating is not possible.
+   * Returns false if IUPAC wildcards are allowed or if the collection changed
+   * in any other way, in which case the index has to be rebuilt. */
+  bool update(const Seeding::Collection &collection,
+              bool allow_iupac_wildcards) {
+    if (allow_iupac_wildcards)
+      return false;
+
+    const auto &text = index.text();
+    std::vector<size_t> seq_begin(seq2set.size() + 1, text.size());
+    for (size_t pos = text.size(); pos > 0; pos--)
+      seq_begin[pos2seq[pos - 1]] = pos - 1;
+
+    std::vector<bool> now_masked(text.size(), false);
+    if (not masked.empty())
+      now_masked = masked;
+    auto mask_seq = [&](size_t seq_idx) {
+      for (size_t pos = seq_begin[seq_idx]; pos < seq_begin[seq_idx + 1]; pos++)
+        now_masked[pos] = true;
+    };
+
+    // sequences are removed or masked but not reordered, so each sequence of
+    // the collection corresponds to the next sequence of the same set in the
+    // index whose symbols agree with it except for masked ones
+    size_t seq_idx = 0, set_idx = 0;
+    seq_type code;
+    for (auto &contrast : collection)
+      for (auto &dataset : contrast) {
+        for (auto &seq : dataset) {
+          code.clear();
+          add_sequence(code, seq.sequence, allow_iupac_wildcards);
+          while (true) {
+            if (seq_idx == seq2set.size() or seq2set[seq_idx] != set_idx)
+              return false;
+            size_t first = seq_begin[seq_idx];
+            bool agrees = seq_begin[seq_idx + 1] - first == code.size() + 1;
+            for (size_t i = 0; agrees and i < code.size(); i++)
+              agrees = code[i] == text[first + i] or code[i] == 0;
+            if (agrees)
+              break;
+            mask_seq(seq_idx++);
+          }
+          for (size_t i = 0; i < code.size(); i++)
+            if (code[i] != text[seq_begin[seq_idx] + i])
+              now_masked[seq_begin[seq_idx] + i] = true;
+          seq_idx++;
+        }
+        while (seq_idx < seq2set.size() and seq2set[seq_idx] == set_idx)
+          mask_seq(seq_idx++);
+        set_idx++;
+      }
+    if (seq_idx != seq2set.size())
+      return false;
+
+    if (std::find(begin(now_masked), end(now_masked), true) != end(now_masked))
+      masked.swap(now_masked);
+    return true;
+  };
+
   std::vector<size_t> word_hits_by_file(const base_type &query,
                                         bool revcomp = false) const {
     std::vector<size_t> counts(paths.size(), 0);
-    for (auto &p : index.find_matches(query, binary_and_not_null<symbol_t>)) {
+    for (auto &p : find_matches(query)) {
       size_t seqIdx = pos2seq[p];
       size_t fileIdx = seq2set[seqIdx];
       counts[fileIdx]++;
@@ -114,7 +287,7 @@ public:
     if (revcomp) {
       auto rc = iupac_reverse_complement(query);
       if (rc != query)
-        for (auto &p : index.find_matches(rc, binary_and_not_null<symbol_t>)) {
+        for (auto &p : find_matches(rc)) {
           size_t seqIdx = pos2seq[p];
           size_t fileIdx = seq2set[seqIdx];
           counts[fileIdx]++;
@@ -126,12 +299,12 @@ public:
   std::vector<size_t> seq_hits_by_file2(const base_type &query,
                                         bool revcomp = false) const {
     std::unordered_set<size_t> seqs;
-    for (auto &p : index.find_matches(query, binary_and_not_null<symbol_t>))
+    for (auto &p : find_matches(query))
       seqs.insert(pos2seq[p]);
     if (revcomp) {
       auto rc = iupac_reverse_complement(query);
       if (rc != query)
-        for (auto &p : index.find_matches(rc, binary_and_not_null<symbol_t>))
+        for (auto &p : find_matches(rc))
           seqs.insert(pos2seq[p]);
     }
 
@@ -144,12 +317,12 @@ public:
   std::vector<size_t> seq_hits_by_file(const base_type &query,
                                        bool revcomp = false) const {
     std::vector<size_t> seqs;
-    for (auto &p : index.find_matches(query, binary_and_not_null<symbol_t>))
+    for (auto &p : find_matches(query))
       seqs.push_back(pos2seq[p]);
     if (revcomp) {
       auto rc = iupac_reverse_complement(query);
       if (rc != query)
-        for (auto &p : index.find_matches(rc, binary_and_not_null<symbol_t>))
+        for (auto &p : find_matches(rc))
           seqs.push_back(pos2seq[p]);
     }
 
@@ -164,8 +337,49 @@ public:
 
 private:
   std::vector<std::string> paths;
-  std::vector<size_t> pos2seq, seq2set, set2contrast;
+  std::vector<idx_t> pos2seq;
+  std::vector<size_t> seq2set, set2contrast;
   index_t index;
+  std::vector<bool> masked;  // positions masked by update(); empty if none
+
+  /** Occurrences of a query that do not overlap masked positions */
+  std::vector<idx_t> find_matches(const base_type &query) const {
+    auto hits = index.find_matches(query, binary_and_not_null<symbol_t>);
+    if (not masked.empty()) {
+      auto overlaps_mask = [&](idx_t p) {
+        for (size_t i = 0; i < query.size(); i++)
+          if (masked[p + i])
+            return true;
+        return false;
+      };
+      hits.erase(std::remove_if(begin(hits), end(hits), overlaps_mask),
+                 end(hits));
+    }
+    return hits;
+  };
+};
+
+/** Nucleotide index with 32 bit positions for collections small enough, and
+ * 64 bit positions otherwise. LCP values take a single byte, which suffices
+ * as motifs are much shorter than 255 nucleotides. */
+class CompactNucleotideIndex {
+public:
+  CompactNucleotideIndex(Verbosity verbosity = Verbosity::info);
+  CompactNucleotideIndex(const Seeding::Collection &collection,
+                         bool allow_iupac_wildcards, Verbosity verbosity);
+
+  std::vector<size_t> word_hits_by_file(const seq_type &query,
+                                        bool revcomp = false) const;
+  std::vector<size_t> seq_hits_by_file(const seq_type &query,
+                                       bool revcomp = false) const;
+  /** See NucleotideIndex::update() */
+  bool update(const Seeding::Collection &collection,
+              bool allow_iupac_wildcards);
+
+private:
+  bool compact;
+  NucleotideIndex<uint32_t, uint8_t> index32;
+  NucleotideIndex<size_t, uint8_t> index64;
 };
 
 #endif
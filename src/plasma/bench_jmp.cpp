@@ -0,0 +1,110 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  bench_jmp.cpp
+ *
+ *    Description:  Benchmark of LCP and JMP table construction on low
+ *                  complexity inputs
+ *
+ * =====================================================================================
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "code.hpp"
+#include "suffix.hpp"
+#include "../aux.hpp"
+#include "../timer.hpp"
+
+using namespace std;
+
+/** Inputs longer than this are not benchmarked with the quadratic algorithm */
+const size_t max_quadratic_length = 100000;
+
+/** The quadratic construction of the JMP table that gen_jmp() replaced; it is
+ * kept here as a reference for timings and results */
+template <class idx_t, class lcp_t>
+vector<idx_t> gen_jmp_quadratic(const vector<lcp_t> &lcp) {
+  idx_t n = lcp.size();
+  vector<idx_t> jmp(n);
+  for (idx_t i = 0; i < n; i++) {
+    jmp[i] = i + 1;
+    size_t j = i + 1;
+    while (j < n and lcp[j++] > lcp[i])
+      jmp[i]++;
+  }
+  return jmp;
+}
+
+/** An input of length n whose last symbol is the terminator, encoded as 0 */
+seq_type gen_input(const string &kind, size_t n, mt19937 &rng) {
+  auto code = [](char c) { return Seeding::Symbol.find(c); };
+  seq_type s(n, 0);
+  for (size_t i = 0; i + 1 < n; i++)
+    if (kind == "poly-A")
+      s[i] = code('a');
+    else if (kind == "(AB)^n")
+      s[i] = code(i % 2 ? 'c' : 'a');
+    else
+      s[i] = code("acgt"[rng() % 4]);
+  return s;
+}
+
+/** Time LCP and JMP construction, as done by Index, for one LCP type */
+template <class lcp_t>
+void bench(const string &kind, const string &lcp_name, const seq_type &s,
+           const vector<uint32_t> &sa) {
+  const size_t width = 12;
+  Timer timer;
+  auto lcp = gen_lcp<lcp_t>(begin(s), end(s), sa, Verbosity::error);
+  double t_lcp = timer.tock();
+  timer.tick();
+  auto jmp = gen_jmp<uint32_t>(lcp, Verbosity::error);
+  double t_jmp = timer.tock();
+  string quadratic = "-";
+  if (s.size() <= max_quadratic_length) {
+    timer.tick();
+    auto ref = gen_jmp_quadratic<uint32_t>(lcp);
+    quadratic = time_to_pretty_string(timer.tock());
+    if (ref != jmp) {
+      cerr << "Error: JMP tables differ for " << kind << " of length "
+           << s.size() << "." << endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  cout << setw(width) << left << kind << setw(width) << right << s.size()
+       << setw(width) << lcp_name
+       << setw(width) << time_to_pretty_string(t_lcp)
+       << setw(width) << time_to_pretty_string(t_jmp)
+       << setw(width) << quadratic << endl;
+}
+
+int main(int argc, const char **argv) {
+  vector<size_t> sizes;
+  for (int i = 1; i < argc; i++)
+    sizes.push_back(atoll(argv[i]));
+  if (sizes.empty())
+    sizes = {10000, 30000, 100000, 1000000};
+
+  const size_t width = 12;
+  cout << setw(width) << left << "input" << setw(width) << right << "length"
+       << setw(width) << "lcp_t" << setw(width) << "LCP"
+       << setw(width) << "JMP" << setw(width) << "JMP (old)" << endl;
+
+  mt19937 rng(1);
+  for (auto kind : {"poly-A", "(AB)^n", "ACGT"})
+    for (auto n : sizes) {
+      seq_type s = gen_input(kind, n, rng);
+      auto sa = gen_suffix_array<true, uint32_t>(begin(s), end(s),
+                                                 Verbosity::error);
+      // NucleotideIndex caps the LCP values at 255
+      bench<uint8_t>(kind, "uint8_t", s, sa);
+      bench<size_t>(kind, "size_t", s, sa);
+    }
+  return EXIT_SUCCESS;
+}
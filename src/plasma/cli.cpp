@@ -164,6 +164,7 @@ boost::program_options::options_description gen_plasma_options_description(
       ("print", po::bool_switch(&options.dump_viterbi), "Print out sequences annotated with motif occurrences.")
       ("bed", po::bool_switch(&options.dump_bed), "Generate a BED file with positions of motif occurrence.")
       ("threads", po::value(&options.n_threads), "Number of threads. If not given, as many are used as there are CPU cores on this machine.")
+      ("cache", po::value(&options.cache_directory), "Directory in which to cache parsed FASTA files. Subsequent runs on the same files, with the same --revcomp and --nseq settings, load the cached sequences instead of parsing the files. For files with shuffles or characters other than ACGTU, cached sequences are only used with the same --salt. The suffix indices used for seeding are cached there as well.")
       ("output,o", po::value(&options.label),
        "Output file names are generated from this label. If not given, the output label will be 'plasma_XXX' where XXX is a string to make the label unique. The output files comprise:\n"
        "If --pdf or -png are used, sequence logos of the found motifs are generated with file names based on this output label.")
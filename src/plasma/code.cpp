@@ -15,6 +15,7 @@
 #include <algorithm>
 #include <iostream>
 #include "code.hpp"
+#include "fasta.hpp"
 
 using namespace std;
 
@@ -173,6 +174,17 @@ void add_sequence(vector<symbol_t> &s, const string &seq,
       s.push_back(Seeding::PureCode[static_cast<symbol_t>(x)]);
 }
 
+void add_sequence(vector<symbol_t> &s, const Fasta::PackedSequence &seq,
+                  bool allow_iupac_wildcards) {
+  const size_t n = s.size();
+  s.resize(n + seq.size());
+  seq.decode(reinterpret_cast<char *>(s.data() + n), 0, seq.size());
+  const vector<symbol_t> &code
+      = allow_iupac_wildcards ? Seeding::Code : Seeding::PureCode;
+  for (auto iter = begin(s) + n; iter != end(s); ++iter)
+    *iter = code[*iter];
+}
+
 using nucl_vector_type = vector<bool>;
 
 nucl_vector_type build_pure_nucl_vector() {
@@ -33,6 +33,10 @@
 #include <string>
 #include <vector>
 
+namespace Fasta {
+class PackedSequence;
+}
+
 namespace Seeding {
 const std::string Symbol = "-acmgrsvtwyhkdbn";
 std::string iupac2regex(const std::string &s);
@@ -57,6 +61,9 @@ std::string decode(const seq_type &seq);
  */
 void add_sequence(seq_type &s, const std::string &seq,
                   bool allow_iupac_wildcards);
+/** As above, decoding the packed sequence directly into s */
+void add_sequence(seq_type &s, const Fasta::PackedSequence &seq,
+                  bool allow_iupac_wildcards);
 
 bool pure_nucleotide(symbol_t s);
 bool degenerate_nucleotide(symbol_t s);
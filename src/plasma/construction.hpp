@@ -6,7 +6,9 @@
  * Stefan Burkhardt
  */
 
+#include <algorithm>
 #include <vector>
+#include <omp.h>
 
 template <typename X, typename Y>
 inline bool leq(X a1, Y a2, X b1, Y b2) {  // lexic. order for pairs
@@ -18,10 +20,83 @@ inline bool leq(X a1, Y a2, Z a3, X b1, Y b2, Z b3) {
   return a1 < b1 || (a1 == b1 && leq(a2, a3, b2, b3));
 }
 
+// the number of threads to use for n elements; small inputs are not worth
+// the overhead of parallelization
+inline int constructionThreads(size_t n) {
+  return n < (1 << 16) ? 1 : omp_get_max_threads();
+}
+
+// call f(first, last, t) for the contiguous blocks [first, last) of 0..n-1
+// assigned to threads t = 0..n_threads-1; a single thread calls f directly,
+// as code in parallel regions is less well optimized
+template <typename idx_t, typename F>
+void forEachBlock(idx_t n, int n_threads, F f) {
+  if (n_threads == 1) {
+    f(idx_t(0), n, 0);
+    return;
+  }
+#pragma omp parallel for num_threads(n_threads) schedule(static, 1)
+  for (int t = 0; t < n_threads; t++)
+    f(static_cast<size_t>(n) * t / n_threads,
+      static_cast<size_t>(n) * (t + 1) / n_threads, t);
+}
+
+// stably sort a[0..n-1] to b[0..n-1] by the digit (r[a[i]] >> shift) & mask
+// each thread counts the digits of a contiguous block of a, and places its
+// elements after those of the same digit from the preceding blocks
+template <typename idx_t, typename Iter>
+void radixPassDigit(const std::vector<idx_t> &a, std::vector<idx_t> &b,
+                    Iter r, idx_t n, size_t shift, size_t mask,
+                    int n_threads) {
+  const size_t n_buckets = mask + 1;
+  std::vector<idx_t> c(n_threads * n_buckets, 0);
+  forEachBlock(n, n_threads, [&](idx_t first, idx_t last, int t) {
+    idx_t *cnt = c.data() + t * n_buckets;
+    for (idx_t i = first; i < last; i++)
+      cnt[(static_cast<size_t>(r[a[i]]) >> shift) & mask]++;
+  });
+  // exclusive prefix sums, by digit and then by block
+  for (size_t k = 0, sum = 0; k < n_buckets; k++)
+    for (int t = 0; t < n_threads; t++) {
+      idx_t x = c[t * n_buckets + k];
+      c[t * n_buckets + k] = sum;
+      sum += x;
+    }
+  forEachBlock(n, n_threads, [&](idx_t first, idx_t last, int t) {
+    idx_t *cnt = c.data() + t * n_buckets;
+    for (idx_t i = first; i < last; i++)
+      b[cnt[(static_cast<size_t>(r[a[i]]) >> shift) & mask]++] = a[i];
+  });
+}
+
 // stably sort a[0..n-1] to b[0..n-1] with keys in 0..K from r
 template <typename idx_t, typename Iter>
 void radixPass(const std::vector<idx_t> &a, std::vector<idx_t> &b, Iter r,
                idx_t n, idx_t K) {
+  const int n_threads = constructionThreads(n);
+  if (n_threads > 1) {
+    // least-significant-digit first, with up to 16 bits per digit
+    const size_t digit_bits = 16;
+    size_t key_bits = 1;
+    while (key_bits < 8 * sizeof(size_t)
+           and (static_cast<size_t>(K) >> key_bits) > 0)
+      key_bits++;
+    if (key_bits <= digit_bits) {
+      radixPassDigit(a, b, r, n, 0, (size_t(1) << key_bits) - 1, n_threads);
+      return;
+    }
+    std::vector<idx_t> tmp(n);
+    const size_t n_digits = (key_bits + digit_bits - 1) / digit_bits;
+    const size_t mask = (size_t(1) << digit_bits) - 1;
+    // alternate between b and tmp such that the last pass writes to b
+    const std::vector<idx_t> *src = &a;
+    for (size_t d = 0; d < n_digits; d++) {
+      std::vector<idx_t> &dst = (n_digits - d) % 2 == 1 ? b : tmp;
+      radixPassDigit(*src, dst, r, n, d * digit_bits, mask, n_threads);
+      src = &dst;
+    }
+    return;
+  }
   // counter array
   std::vector<idx_t> c(K + 1, 0);
   // count occurrences
@@ -38,6 +113,84 @@ void radixPass(const std::vector<idx_t> &a, std::vector<idx_t> &b, Iter r,
     b[c[r[a[i]]]++] = a[i];
 };
 
+// name the triples at SA12[first..last-1] in s12, continuing from name, the
+// number of distinct triples before first
+template <typename idx_t, typename Iter>
+void nameTriples(Iter begin, const std::vector<idx_t> &SA12,
+                 std::vector<idx_t> &s12, idx_t n0, idx_t first, idx_t last,
+                 idx_t name) {
+  // the last distinct triple
+  typename Iter::value_type c0 = 0, c1 = 0, c2 = 0;
+  if (first > 0) {
+    c0 = begin[SA12[first - 1]];
+    c1 = begin[SA12[first - 1] + 1];
+    c2 = begin[SA12[first - 1] + 2];
+  }
+  for (idx_t i = first; i < last; i++) {
+    if (i == 0 or begin[SA12[i]] != c0 || begin[SA12[i] + 1] != c1
+        || begin[SA12[i] + 2] != c2) {
+      name++;
+      c0 = begin[SA12[i]];
+      c1 = begin[SA12[i] + 1];
+      c2 = begin[SA12[i] + 2];
+    }
+
+    if (SA12[i] % 3 == 1)
+      // left half
+      s12[SA12[i] / 3] = name;
+    else
+      // right half
+      s12[SA12[i] / 3 + n0] = name;
+  }
+}
+
+// merge sorted SA0 suffixes and sorted SA12 suffixes into SA[k..last-1]
+// the numbers of suffixes of either kind that precede position k are found
+// by binary search
+template <typename idx_t, typename Iter>
+void mergeSuffixes(Iter begin, const std::vector<idx_t> &SA12,
+                   const std::vector<idx_t> &SA0, const std::vector<idx_t> &s12,
+                   std::vector<idx_t> &SA, idx_t n0, idx_t n1, idx_t n02,
+                   idx_t k, idx_t last) {
+#define GetI() (SA12[t] < n0 ? SA12[t] * 3 + 1 : (SA12[t] - n0) * 3 + 2)
+  // whether the offset 12 suffix at position i is smaller than the offset 0
+  // suffix at position j
+#define Smaller(i, j)                                                         \
+  (SA12[t] < n0 ? leq(begin[i], s12[SA12[t] + n0], begin[j], s12[j / 3])      \
+                : leq(begin[i], begin[i + 1], s12[SA12[t] - n0 + 1], begin[j], \
+                      begin[j + 1], s12[j / 3 + n0]))
+  // the "n0-n1" skips the dummy mod 1 suffix
+  const idx_t t0 = n0 - n1;
+  idx_t lo = k > n0 ? k - n0 : 0, hi = std::min<idx_t>(k, n02 - t0);
+  while (lo < hi) {
+    idx_t mid = lo + (hi - lo) / 2, t = t0 + mid;
+    idx_t i = GetI(), j = SA0[k - mid - 1];
+    if (Smaller(i, j))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  idx_t t = t0 + lo, p = k - lo;
+  for (; k < last and t < n02 and p < n0; k++) {
+    idx_t i = GetI();  // pos of current offset 12 suffix
+    idx_t j = SA0[p];  // pos of current offset 0  suffix
+    if (Smaller(i, j)) {  // suffix from SA12 is smaller
+      SA[k] = i;
+      t++;
+    } else {
+      SA[k] = j;
+      p++;
+    }
+  }
+  // only suffixes of one kind are left
+  for (; k < last and t < n02; k++, t++)
+    SA[k] = GetI();
+  for (; k < last; k++, p++)
+    SA[k] = SA0[p];
+#undef Smaller
+#undef GetI
+}
+
 // find the suffix array SA of s[0..n-1] in {1..K}^n
 // require s[n]=s[n+1]=s[n+2]=0, n>=2
 // NOTE the input is not supposed to contain zeros!
@@ -62,37 +215,45 @@ void suffixArray(Iter begin, Iter end, std::vector<idx_t> &SA, idx_t n,
   radixPass(s12, SA12, begin, n02, K);
 
   // find lexicographic names of triples
-  idx_t name = 0;
-  typename Iter::value_type c0 = 0, c1 = 0, c2 = 0;
-  bool first = true;
-  for (idx_t i = 0; i < n02; i++) {
-    if (first or begin[SA12[i]] != c0 || begin[SA12[i] + 1] != c1
-        || begin[SA12[i] + 2] != c2) {
-      name++;
-      c0 = begin[SA12[i]];
-      c1 = begin[SA12[i] + 1];
-      c2 = begin[SA12[i] + 2];
-      first = false;
-    }
-
-    if (SA12[i] % 3 == 1)
-      // left half
-      s12[SA12[i] / 3] = name;
-    else
-      // right half
-      s12[SA12[i] / 3 + n0] = name;
-  }
+  // each thread names the triples of a contiguous block of SA12, continuing
+  // from the number of distinct triples in the preceding blocks
+  const int n_threads = constructionThreads(n02);
+  auto new_triple = [&](idx_t i) {
+    return i == 0 or begin[SA12[i]] != begin[SA12[i - 1]]
+           or begin[SA12[i] + 1] != begin[SA12[i - 1] + 1]
+           or begin[SA12[i] + 2] != begin[SA12[i - 1] + 2];
+  };
+  std::vector<idx_t> block_names(n_threads, 0);
+  // the count of the last block is not needed
+  forEachBlock(n02, n_threads, [&](idx_t first, idx_t last, int t) {
+    if (t + 1 < n_threads)
+      for (idx_t i = first; i < last; i++)
+        if (new_triple(i))
+          block_names[t + 1]++;
+  });
+  for (int t = 1; t < n_threads; t++)
+    block_names[t] += block_names[t - 1];
+  forEachBlock(n02, n_threads, [&](idx_t first, idx_t last, int t) {
+    nameTriples(begin, SA12, s12, n0, first, last, block_names[t]);
+  });
+  // the number of distinct triples is the last name assigned
+  const idx_t name = n02 == 0 ? 0
+                     : s12[SA12[n02 - 1] % 3 == 1 ? SA12[n02 - 1] / 3
+                                                  : SA12[n02 - 1] / 3 + n0];
 
   // recurse if names are not yet unique
   if (name < n02) {
     suffixArray(s12.begin(), s12.end(), SA12, n02, name);
     // store unique names in s12 using the suffix array
+#pragma omp parallel for num_threads(n_threads)
     for (idx_t i = 0; i < n02; i++)
       s12[SA12[i]] = i + 1;
-  } else
+  } else {
     // generate the suffix array of s12 directly
+#pragma omp parallel for num_threads(n_threads)
     for (idx_t i = 0; i < n02; i++)
       SA12[s12[i] - 1] = i;
+  }
 
   // stably sort the mod 0 suffixes from SA12 by their first character
   for (idx_t i = 0, j = 0; i < n02; i++)
@@ -101,27 +262,8 @@ void suffixArray(Iter begin, Iter end, std::vector<idx_t> &SA, idx_t n,
   radixPass(s0, SA0, begin, n0, K);
 
   // merge sorted SA0 suffixes and sorted SA12 suffixes
-  for (idx_t p = 0, t = n0 - n1, k = 0; k < n; k++) {
-#define GetI() (SA12[t] < n0 ? SA12[t] * 3 + 1 : (SA12[t] - n0) * 3 + 2)
-    idx_t i = GetI();  // pos of current offset 12 suffix
-    idx_t j = SA0[p];  // pos of current offset 0  suffix
-    if (SA12[t] < n0 ? leq(begin[i], s12[SA12[t] + n0], begin[j], s12[j / 3])
-                     : leq(begin[i], begin[i + 1], s12[SA12[t] - n0 + 1],
-                           begin[j], begin[j + 1],
-                           s12[j / 3 + n0])) {  // suffix from SA12 is smaller
-      SA[k] = i;
-      t++;
-      if (t == n02)
-        // done --- only SA0 suffixes left
-        for (k++; p < n0; p++, k++)
-          SA[k] = SA0[p];
-    } else {
-      SA[k] = j;
-      p++;
-      if (p == n0)
-        // done --- only SA12 suffixes left
-        for (k++; t < n02; t++, k++)
-          SA[k] = GetI();
-    }
-  }
+  // each thread fills a contiguous block of SA
+  forEachBlock(n, constructionThreads(n), [&](idx_t first, idx_t last, int) {
+    mergeSuffixes(begin, SA12, SA0, s12, SA, n0, n1, n02, first, last);
+  });
 };
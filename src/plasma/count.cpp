@@ -90,7 +90,7 @@ count_vector_t count_motif(const Collection &collection, const string &motif,
   for (auto &contrast : collection)
     for (auto &dataset : contrast) {
       for (auto &seq : dataset)
-        stats[idx] += count_motif(seq.sequence, motif, options);
+        stats[idx] += count_motif(seq.sequence.string(), motif, options);
       idx++;
     }
   return stats;
@@ -159,6 +159,7 @@ void add_counts(const string &seq_, size_t length, hash_map_t &counts,
 void add_counts(const Set &dataset, size_t len, hash_map_t &counts, size_t idx,
                 const count_vector_t &default_stats, const Options &options) {
   for (auto &seq : dataset)
-    add_counts(seq.sequence, len, counts, idx, default_stats, options);
+    add_counts(seq.sequence.string(), len, counts, idx, default_stats,
+               options);
 }
 }
@@ -50,10 +50,10 @@ RemovalReport operator+(const RemovalReport &a, const RemovalReport &b) {
 }
 
 namespace Seeding {
-Set::Set() : Data::Basic::Set<Fasta::Entry>(){}
+Set::Set() : Data::Basic::Set<Fasta::PackedEntry>(){}
 
 Set::Set(const Specification::Set &s, bool revcomp, size_t n_seq)
-    : Data::Basic::Set<Fasta::Entry>(s, revcomp, n_seq){};
+    : Data::Basic::Set<Fasta::PackedEntry>(s, revcomp, n_seq){};
 
 Contrast::Contrast() : Data::Basic::Contrast<Set>(){}
 
@@ -61,6 +61,9 @@ Contrast::Contrast(const string &name, const Specification::Sets &paths,
                    bool revcomp, size_t n_seq)
     : Data::Basic::Contrast<Set>(name, paths, revcomp, n_seq){}
 
+Contrast::Contrast(const string &name, sets_t &&sets)
+    : Data::Basic::Contrast<Set>(name, move(sets)){}
+
 Collection::Collection(const Specification::Sets &paths, bool revcomp,
                        size_t n_seq)
     : Data::Basic::Collection<Contrast>(paths, revcomp, n_seq){}
@@ -30,11 +30,15 @@
 #ifndef DATA_HPP
 #define DATA_HPP
 
+#include <algorithm>
+#include <exception>
 #include <map>
+#include <numeric>
 #include <unordered_map>
 #include <unordered_set>
 #include "specification.hpp"
 #include "fasta.hpp"
+#include "../sha1.hpp"
 
 std::string sha1hash(const std::string &s);
 
@@ -73,7 +77,8 @@ struct Set : public Specification::Set {
 
     set_size = sequences.size();
     for (auto &seq : sequences)
-      seq_size += seq.sequence.size();
+      seq_size += seq.size();
+    sort_by_length();
   };
   template <typename Y>
   Set(const Set<Y> &set)
@@ -84,9 +89,10 @@ struct Set : public Specification::Set {
         sha1(set.sha1) {
     for (auto &seq : set) {
       seq_t s(seq);
-      seq_size += s.sequence.size();
+      seq_size += s.size();
       sequences.push_back(s);
     }
+    sort_by_length();
   };
 
   // member variables
@@ -94,16 +100,54 @@ struct Set : public Specification::Set {
   size_t seq_size, set_size;
   std::vector<seq_t> sequences;
   std::string sha1;
+  /** Indices of the distinct sequences, longest first; the processing order
+   * for dynamically scheduled loops over the sequences. Of identical
+   * sequences only the first one is included. */
+  std::vector<size_t> by_length;
+  /** For each sequence the index of the first sequence identical to it */
+  std::vector<size_t> representative;
+  /** For each sequence the number of sequences it represents; zero for those
+   * that are not included in by_length */
+  std::vector<size_t> multiplicity;
 
   // methods
 
+  /** Update by_length, representative, and multiplicity; to be called
+   * whenever sequences are added, removed, or changed */
+  void sort_by_length() {
+    std::vector<size_t> order(sequences.size());
+    std::iota(begin(order), end(order), 0);
+    // identical sequences become adjacent, in the order of their indices
+    std::stable_sort(begin(order), end(order), [&](size_t a, size_t b) {
+      const auto &x = sequences[a].sequence;
+      const auto &y = sequences[b].sequence;
+      return x.size() > y.size() or (x.size() == y.size() and x < y);
+    });
+    by_length.clear();
+    representative.resize(sequences.size());
+    multiplicity.assign(sequences.size(), 0);
+    for (auto i : order) {
+      if (by_length.empty()
+          or sequences[i].sequence != sequences[by_length.back()].sequence)
+        by_length.push_back(i);
+      representative[i] = by_length.back();
+      multiplicity[by_length.back()]++;
+    }
+  }
+
+  /** SHA1 of the concatenated sequences, hashed one sequence at a time */
   std::string compute_sha1() const {
-    std::string d;
-    for (auto &s : sequences)
-      d += s.sequence;
-    return sha1hash(d);
+    sha1::Context context;
+    for (auto &s : sequences) {
+      const std::string t = text(s.sequence);
+      context.update(t.data(), t.size());
+    }
+    return context.hexdigest();
   }
 
+  static const std::string &text(const std::string &s) { return s; }
+  static std::string text(const Fasta::PackedSequence &s) { return s.string(); }
+
   RemovalReport mask(const mask_sub_t &mask) {
     RemovalReport report;
     for (auto &seq : sequences) {
@@ -113,6 +157,7 @@ struct Set : public Specification::Set {
         report.nucleotides += seq.mask(iter->second);
       }
     }
+    sort_by_length();
     return report;
   }
 
@@ -134,8 +179,7 @@ struct Set : public Specification::Set {
         report.sequences++;
         report.nucleotides += iter->sequence.size();
         set_size--;
-        seq_size -= iter->sequence.size();  // TODO: find out if this is correct
-                                            // for reverse complements
+        seq_size -= iter->size();
         auto i = iter;
         bool done = (++i) == sequences.rend();
         sequences.erase(--(iter++).base());
@@ -146,10 +190,38 @@ struct Set : public Specification::Set {
       if (noisy_output)
         std::cout << "idxB = " << idx++ << std::endl;
     }
+    sort_by_length();
     return report;
   }
 };
 
+/** Load the sets of the specifications concurrently. Each file is read
+ * with its own random stream, seeded in the order of the specifications,
+ * so that shuffles and random nucleotides do not depend on the number of
+ * threads. */
+template <typename S>
+std::vector<S> load_sets(const Specification::Sets &specs, bool revcomp,
+                         size_t n_seq) {
+  const size_t n = specs.size();
+  std::vector<size_t> seeds;
+  for (size_t i = 0; i < n; i++)
+    seeds.push_back(Fasta::EntropySource::derive_seed());
+  std::vector<S> sets(n);
+  std::vector<std::exception_ptr> errors(n);
+#pragma omp parallel for schedule(dynamic)
+  for (size_t i = 0; i < n; i++)
+    try {
+      Fasta::EntropySource::Stream stream(seeds[i]);
+      sets[i] = S(specs[i], revcomp, n_seq);
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+  for (auto &error : errors)
+    if (error)
+      std::rethrow_exception(error);
+  return sets;
+}
+
 template <typename X>
 struct Contrast {
   // typedefs
@@ -165,9 +237,9 @@ struct Contrast {
   Contrast() : seq_size(0), set_size(0), sets(), name(){};
   Contrast(const std::string &name_, const Specification::Sets &specs,
            bool revcomp = false, size_t n_seq = 0)
-      : seq_size(0), set_size(0), sets(), name(name_) {
-    for (auto &spec : specs)
-      sets.push_back({spec, revcomp, n_seq});
+      : Contrast(name_, load_sets<set_t>(specs, revcomp, n_seq)){};
+  Contrast(const std::string &name_, sets_t &&sets_)
+      : seq_size(0), set_size(0), sets(std::move(sets_)), name(name_) {
     for (auto &s : sets) {
       seq_size += s.seq_size;
       set_size += s.set_size;
@@ -244,11 +316,13 @@ struct Collection {
   Collection(const Specification::Sets &specs, bool revcomp = false,
              size_t n_seq = 0)
       : seq_size(0), set_size(0), contrasts() {
-    std::map<std::string, Specification::Sets> map;
-    for (auto &spec : specs)
-      map[spec.contrast].push_back(spec);
+    // the sets of all contrasts are loaded together
+    auto sets = load_sets<set_t>(specs, revcomp, n_seq);
+    std::map<std::string, typename contrast_t::sets_t> map;
+    for (size_t i = 0; i < specs.size(); i++)
+      map[specs[i].contrast].push_back(std::move(sets[i]));
     for (auto &iter : map)
-      contrasts.push_back(contrast_t(iter.first, iter.second, revcomp, n_seq));
+      contrasts.push_back(contrast_t(iter.first, std::move(iter.second)));
     for (auto &s : contrasts) {
       seq_size += s.seq_size;
       set_size += s.set_size;
@@ -364,18 +438,19 @@ typename Collection<X>::const_iterator end(const Collection<X> &collection) {
 
 namespace Seeding {
 
-struct Set : public Data::Basic::Set<Fasta::Entry> {
+struct Set : public Data::Basic::Set<Fasta::PackedEntry> {
   Set();
   Set(const Specification::Set &s, bool revcomp = false, size_t n_seq = 0);
   template <typename X>
   Set(const Data::Basic::Set<X> &s)
-      : Data::Basic::Set<Fasta::Entry>(s){};
+      : Data::Basic::Set<Fasta::PackedEntry>(s){};
 };
 
 struct Contrast : public Data::Basic::Contrast<Set> {
   Contrast();
   Contrast(const std::string &name, const Specification::Sets &s,
            bool revcomp = false, size_t n_seq = 0);
+  Contrast(const std::string &name, sets_t &&sets);
   template <typename X>
   Contrast(const Data::Basic::Contrast<X> &s)
       : Data::Basic::Contrast<Set>(s){};
@@ -1,9 +1,15 @@
 
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <random>
+#include <sstream>
+#include <boost/iostreams/device/mapped_file.hpp>
 #include "fasta.hpp"
 #include "../random_distributions.hpp"
 #include "../shuffle/dinucleotide_shuffle.hpp"
 #include "../aux.hpp"
+#include "../sha1.hpp"
 #include "io.hpp"
 #include "../verbosity.hpp"
 
@@ -23,113 +29,289 @@ namespace Fasta {
 // Disallow gaps of indeterminate length '-'
 static const string valid_nucleotides = "acgtnuksymwrbdhy";
 
-mt19937 Fasta::EntropySource::shuffling_rng;
-mt19937 Fasta::EntropySource::random_nucl_rng;
+thread_local mt19937 Fasta::EntropySource::shuffling_rng;
+thread_local mt19937 Fasta::EntropySource::random_nucl_rng;
+string Cache::directory;
+
+string EntropySource::state() {
+  ostringstream os;
+  os << shuffling_rng << ' ' << random_nucl_rng;
+  return os.str();
+}
+
+void EntropySource::set_state(const string &state) {
+  istringstream is(state);
+  is >> shuffling_rng >> random_nucl_rng;
+}
 
 Entry::Entry() : definition(), sequence(){};
 Entry::Entry(const Entry &entry)
     : definition(entry.definition), sequence(entry.sequence){};
-Entry::Entry(const IEntry &ientry) : definition(ientry.definition), sequence() {
-  size_t pos = ientry.sequence.find("$");
-  sequence = ientry.sequence.substr(0, pos);
+/** Nucleotide codes by character; characters other than 'acgtu' are
+ * marked by 4 and get assigned random nucleotides */
+static array<PackedSequence::code_t, 256> make_code_table() {
+  array<PackedSequence::code_t, 256> table;
+  table.fill(4);
+  const string nucleotides = "acgtu";
+  for (size_t i = 0; i < nucleotides.size(); i++) {
+    table[static_cast<unsigned char>(nucleotides[i])] = min<size_t>(i, 3);
+    table[static_cast<unsigned char>(toupper(nucleotides[i]))]
+        = min<size_t>(i, 3);
+  }
+  return table;
 }
 
-size_t Entry::mask(const vector<size_t> &positions) {
-  size_t masked_nucleotides = 0;
-  const char mask_symbol = 'n';
-  const Verbosity verbosity = Verbosity::info;
-  if (verbosity >= Verbosity::debug) {
-    cout << "Masking " << definition << endl << sequence << endl;
-    size_t idx = 0;
-    for (auto pos : positions) {
-      while (idx < pos) {
-        cout << "-";
-        idx++;
+PackedSequence::PackedSequence(const std::string &s, bool random_codes)
+    : length(s.size()),
+      words((s.size() + per_word - 1) / per_word, 0),
+      exceptions(),
+      upper_case(),
+      thymine('t') {
+  static const array<code_t, 256> code_table = make_code_table();
+
+  if (s.find_first_of("uU") != std::string::npos) {
+    size_t n_t = 0, n_u = 0;
+    for (auto c : s)
+      switch (c) {
+        case 't':
+        case 'T':
+          n_t++;
+          break;
+        case 'u':
+        case 'U':
+          n_u++;
+          break;
       }
-      cout << "X";
-      idx++;
-      masked_nucleotides++;
-    }
-    while (idx < sequence.size()) {
-      cout << "-";
-      idx++;
+    if (n_u > n_t)
+      thymine = 'u';
+  }
+  const std::string spelling = std::string("acg") + thymine;
+
+  auto add_run = [](vector<Run> &runs, size_t pos, char c) {
+    if (not runs.empty() and runs.back().end == pos and runs.back().c == c)
+      runs.back().end++;
+    else
+      runs.push_back({pos, pos + 1, c});
+  };
+
+  for (size_t i = 0; i < length; i++) {
+    char c = s[i];
+    word_t code = code_table[static_cast<unsigned char>(c)];
+    if (code > 3)
+      code = random_codes ? RandomDistribution::Nucleotide(
+                                EntropySource::random_nucl_rng)
+                          : 0;
+    words[i / per_word] |= code << (2 * (i % per_word));
+    if (c != spelling[code]) {
+      char lower = tolower(c);
+      if (lower != spelling[code])
+        add_run(exceptions, i, lower);
+      if (lower != c)
+        add_run(upper_case, i, 'U');
     }
-    cout << endl;
   }
-  for (auto pos : positions) {
-    if (pos >= sequence.size())
-      pos = 2 * sequence.size() - pos;
-    sequence[pos] = mask_symbol;
+}
+
+void PackedSequence::decode(char *s, size_t first, size_t last) const {
+  const std::string spelling = std::string("acg") + thymine;
+  for (size_t i = first; i < last; i++)
+    s[i - first] = spelling[(*this)[i]];
+  auto by_end = [](const Run &run, size_t pos) { return run.end <= pos; };
+  for (auto iter = lower_bound(begin(exceptions), end(exceptions), first,
+                               by_end);
+       iter != end(exceptions) and iter->begin < last; iter++)
+    for (size_t i = max(first, iter->begin); i < min(last, iter->end); i++)
+      s[i - first] = iter->c;
+  for (auto iter = lower_bound(begin(upper_case), end(upper_case), first,
+                               by_end);
+       iter != end(upper_case) and iter->begin < last; iter++)
+    for (size_t i = max(first, iter->begin); i < min(last, iter->end); i++)
+      s[i - first] = toupper(s[i - first]);
+}
+
+std::string PackedSequence::string() const {
+  std::string s(length, ' ');
+  decode(&s[0], 0, length);
+  return s;
+}
+
+bool PackedSequence::operator==(const PackedSequence &other) const {
+  if (length != other.length or thymine != other.thymine
+      or exceptions != other.exceptions or upper_case != other.upper_case)
+    return false;
+  if (exceptions.empty())
+    return words == other.words;
+  // the random codes of the exceptions do not matter
+  size_t pos = 0;
+  for (auto &run : exceptions) {
+    for (; pos < run.begin; pos++)
+      if ((*this)[pos] != other[pos])
+        return false;
+    pos = run.end;
   }
-  if (verbosity >= Verbosity::debug)
-    cout << "Masked  " << definition << endl << sequence << endl;
-  return masked_nucleotides;
+  for (; pos < length; pos++)
+    if ((*this)[pos] != other[pos])
+      return false;
+  return true;
 }
 
-/** Convert a string of nucleic acids into an IEntry::seq_t
- * Note: characters other than 'acgt' are assigned random nucleotides
- *       if n_enc < 0.
- **/
-IEntry::seq_t string2seq(const string &s, int n_enc = -1) {
-  IEntry::seq_t seq(s.size());
-  size_t idx = 0;
-  for (auto iter : s) {
-    switch (tolower(iter)) {
-      case 'a':
-        seq[idx] = 0;
-        break;
-      case 'c':
-        seq[idx] = 1;
-        break;
-      case 'g':
-        seq[idx] = 2;
-        break;
-      case 't':
-      case 'u':
-        seq[idx] = 3;
-        break;
-      case '$':
-        seq[idx] = IEntry::empty_symbol;
-        break;
-      default:
-        if (n_enc < 0)
-          seq[idx]
-              = RandomDistribution::Nucleotide(EntropySource::random_nucl_rng);
-        else
-          seq[idx] = n_enc;
+bool PackedSequence::operator<(const PackedSequence &other) const {
+  // compare block-wise, as most comparisons are decided early on
+  const size_t block = 256;
+  std::string x(block, ' '), y(block, ' ');
+  size_t n = min(length, other.length);
+  for (size_t first = 0; first < n; first += block) {
+    size_t last = min(first + block, n);
+    decode(&x[0], first, last);
+    other.decode(&y[0], first, last);
+    int cmp = x.compare(0, last - first, y, 0, last - first);
+    if (cmp != 0)
+      return cmp < 0;
+  }
+  return length < other.length;
+}
+
+ostream &operator<<(ostream &os, const PackedSequence &seq) {
+  os << seq.string();
+  return os;
+}
+
+/** Binary serialization in native byte order; the cache is a local file */
+template <typename T>
+static void write_binary(ostream &os, const T &x) {
+  os.write(reinterpret_cast<const char *>(&x), sizeof(T));
+}
+
+static void write_binary(ostream &os, const std::string &s) {
+  write_binary<uint64_t>(os, s.size());
+  os.write(s.data(), s.size());
+}
+
+template <typename T>
+static bool read_binary(const char *&pos, const char *end, T &x) {
+  if (static_cast<size_t>(end - pos) < sizeof(T))
+    return false;
+  memcpy(&x, pos, sizeof(T));
+  pos += sizeof(T);
+  return true;
+}
+
+static bool read_binary(const char *&pos, const char *end, std::string &s) {
+  uint64_t n;
+  if (not read_binary(pos, end, n) or static_cast<uint64_t>(end - pos) < n)
+    return false;
+  s.assign(pos, n);
+  pos += n;
+  return true;
+}
+
+void PackedSequence::serialize(ostream &os) const {
+  write_binary<uint64_t>(os, length);
+  write_binary(os, thymine);
+  os.write(reinterpret_cast<const char *>(words.data()),
+           words.size() * sizeof(word_t));
+  for (auto runs : {&exceptions, &upper_case}) {
+    write_binary<uint64_t>(os, runs->size());
+    for (auto &run : *runs) {
+      write_binary<uint64_t>(os, run.begin);
+      write_binary<uint64_t>(os, run.end);
+      write_binary(os, run.c);
     }
-    idx++;
   }
-  return seq;
 }
 
-IEntry::IEntry(const Entry &entry)
-    : Entry(entry), isequence(string2seq(entry.sequence)){};
+bool PackedSequence::deserialize(const char *&pos, const char *end) {
+  uint64_t n;
+  if (not read_binary(pos, end, n) or not read_binary(pos, end, thymine)
+      or (thymine != 't' and thymine != 'u'))
+    return false;
+  length = n;
+  words.resize((length + per_word - 1) / per_word);
+  size_t n_bytes = words.size() * sizeof(word_t);
+  if (static_cast<size_t>(end - pos) < n_bytes)
+    return false;
+  memcpy(words.data(), pos, n_bytes);
+  pos += n_bytes;
+  for (auto runs : {&exceptions, &upper_case}) {
+    if (not read_binary(pos, end, n))
+      return false;
+    runs->clear();
+    for (size_t i = 0; i < n; i++) {
+      uint64_t b, e;
+      char c;
+      if (not read_binary(pos, end, b) or not read_binary(pos, end, e)
+          or not read_binary(pos, end, c) or b >= e or e > length
+          or (not runs->empty() and runs->back().end > b))
+        return false;
+      runs->push_back({b, e, c});
+    }
+  }
+  return true;
+}
+
+IEntry::IEntry(const Entry &entry, bool both_strands_)
+    : definition(entry.definition),
+      sequence(entry.sequence),
+      both_strands(both_strands_){};
+
+string IEntry::strands() const {
+  string s = sequence.string();
+  if (both_strands)
+    return s + "$" + ::reverse_complement(s);
+  else
+    return s;
+}
 
 size_t IEntry::mask(const vector<size_t> &positions) {
   size_t masked_nucleotides = 0;
   // uses random nucleotides;
   // const char mask_symbol = 'n';
   // const Verbosity verbosity = Verbosity::info;
-  size_t dollar_position = sequence.find("$");
+  string s = sequence.string();
   for (auto pos : positions) {
+    // positions on the reverse strand are mirrored onto the forward strand
+    if (pos >= s.size())
+      pos = 2 * s.size() - pos;
     // TODO do something more sensible than random nucleotides
     size_t nucl_idx
         = RandomDistribution::Nucleotide(EntropySource::random_nucl_rng);
-    sequence[pos] = "acgt"[nucl_idx];
-    if (dollar_position != string::npos)
-      sequence[sequence.size() - pos - 1] = "tgca"[nucl_idx];
+    s[pos] = "acgt"[nucl_idx];
   }
 
-  isequence = string2seq(sequence);
+  sequence = PackedSequence(s);
   return masked_nucleotides;
 }
 
+PackedEntry::PackedEntry(const Entry &entry)
+    : definition(entry.definition), sequence(entry.sequence){};
+
+PackedEntry::PackedEntry(const IEntry &ientry)
+    : definition(ientry.definition), sequence(ientry.sequence){};
+
+size_t PackedEntry::mask(const vector<size_t> &positions) {
+  const char mask_symbol = 'n';
+  string s = sequence.string();
+  for (auto pos : positions) {
+    // positions on the reverse strand are mirrored onto the forward strand
+    if (pos >= s.size())
+      pos = 2 * s.size() - pos;
+    s[pos] = mask_symbol;
+  }
+  // the codes of the masked positions do not matter; the spelling is used
+  sequence = PackedSequence(s, false);
+  return positions.size();
+}
+
 ostream &operator<<(ostream &os, const Entry &entry) {
   os << entry.string();
   return os;
 }
 
+ostream &operator<<(ostream &os, const IEntry &entry) {
+  os << ">" << entry.definition << "\n" << entry.sequence;
+  return os;
+}
+
 istream &operator>>(istream &is, Entry &entry) {
   // consume until '>'
   char c;
@@ -175,46 +357,112 @@ istream &operator>>(istream &is, IEntry &ientry) {
   return is;
 }
 
-istream &operator>>(istream &is, vector<Entry> &seqs) {
+/** Classification of characters for parse_fasta(): the characters of
+ * valid_nucleotides in either case are kept, white space is skipped, and
+ * anything else is invalid */
+enum class CharClass : char { Invalid, Space, Nucleotide };
+
+static array<CharClass, 256> make_char_table() {
+  array<CharClass, 256> table;
+  for (size_t i = 0; i < table.size(); i++)
+    table[i] = isspace(i) ? CharClass::Space : CharClass::Invalid;
+  for (auto c : valid_nucleotides) {
+    table[static_cast<unsigned char>(c)] = CharClass::Nucleotide;
+    table[static_cast<unsigned char>(toupper(c))] = CharClass::Nucleotide;
+  }
+  return table;
+}
+
+void parse_fasta(istream &is, const function<bool(Entry &)> &fnc) {
+  static const array<CharClass, 256> char_class = make_char_table();
+  const size_t block_size = 1 << 20;
+  vector<char> buffer(block_size);
+
+  enum class State { Start, Definition, Sequence };
+  State state = State::Start;
   Entry entry;
-  while (is >> entry)
-    seqs.push_back(move(entry));
+  bool proceed = true;
+
+  while (proceed and is) {
+    is.read(buffer.data(), block_size);
+    const char *pos = buffer.data(), *end = pos + is.gcount();
+    while (proceed and pos != end)
+      switch (state) {
+        case State::Start:
+          // consume until '>'
+          pos = find(pos, end, '>');
+          if (pos != end) {
+            pos++;
+            entry.definition.clear();
+            state = State::Definition;
+          }
+          break;
+        case State::Definition: {
+          const char *eol = find(pos, end, '\n');
+          entry.definition.append(pos, eol);
+          pos = eol;
+          if (pos != end) {
+            pos++;
+            entry.sequence.clear();
+            state = State::Sequence;
+          }
+        } break;
+        case State::Sequence:
+          while (pos != end) {
+            // append stretches of nucleotides at once
+            const char *first = pos;
+            while (pos != end
+                   and char_class[static_cast<unsigned char>(*pos)]
+                           == CharClass::Nucleotide)
+              pos++;
+            entry.sequence.append(first, pos);
+            if (pos == end)
+              break;
+            char c = *pos;
+            if (c == '>') {
+              pos++;
+              proceed = fnc(entry);
+              entry.definition.clear();
+              state = State::Definition;
+              break;
+            } else if (char_class[static_cast<unsigned char>(c)]
+                       == CharClass::Invalid)
+              throw Exception::NucleicAcids::InvalidNucleotideCode(c);
+            pos++;
+          }
+          break;
+      }
+  }
 
-  // vector<Entry> is defined as zero or more sequences
-  // so if no entries are read and end-of-file is reached, we clear the fail bit
-  is.clear((is.eof() ? ios_base::eofbit : ios_base::goodbit)
-         | (is.bad() ? ios_base::badbit : ios_base::goodbit));
+  // a definition line that is cut short by the end of the file is discarded
+  if (proceed and state == State::Sequence)
+    fnc(entry);
 
+  // reaching the end of the file is not an error
+  if (not is.bad())
+    is.clear(is.eof() ? ios_base::eofbit : ios_base::goodbit);
+}
+
+istream &operator>>(istream &is, vector<Entry> &seqs) {
+  // vector<Entry> is defined as zero or more sequences
+  parse_fasta(is, [&](Entry &entry) {
+    seqs.push_back(entry);
+    return true;
+  });
   return is;
 }
 
 istream &operator>>(istream &is, vector<IEntry> &seqs) {
-  IEntry entry;
-  while (is >> entry)
-    seqs.push_back(move(entry));
-
   // vector<IEntry> is defined as zero or more sequences
-  // so if no entries are read and end-of-file is reached, we clear the fail bit
-  is.clear((is.eof() ? ios_base::eofbit : ios_base::goodbit)
-         | (is.bad() ? ios_base::badbit : ios_base::goodbit));
-
+  parse_fasta(is, [&](Entry &entry) {
+    seqs.push_back(IEntry(entry));
+    return true;
+  });
   return is;
 }
 
-void read_fasta(const string &path, vector<Entry> &sequences, bool revcomp,
-                size_t n_seq, bool shuffled) {
-  try {
-    parse_file(path, [&](istream &is) { is >> sequences; });
-  } catch (runtime_error &e) {
-    std::cout << "Error while reading FASTA file " << path << "." << std::endl;
-    throw e;
-  }
-
-  // TODO: improve efficiency by only reading in n_seq sequences
-  if (n_seq > 0 and sequences.size() > n_seq)
-    sequences.resize(n_seq);
-
-  if (sequences.size() == 0) {
+static void warn_if_empty(const string &path, size_t n, bool shuffled) {
+  if (n == 0) {
     // TODO: throw exception?
     if (not shuffled)
       cout << "Warning while parsing FASTA format file " << path
@@ -225,6 +473,24 @@ void read_fasta(const string &path, vector<Entry> &sequences, bool revcomp,
     cout << "Please check the format of this file and whether it is the right "
             "file." << endl;
   }
+}
+
+void read_fasta(const string &path, vector<Entry> &sequences, bool revcomp,
+                size_t n_seq, bool shuffled) {
+  try {
+    // only the first n_seq sequences are read
+    parse_file(path, [&](istream &is) {
+      parse_fasta(is, [&](Entry &entry) {
+        sequences.push_back(entry);
+        return n_seq == 0 or sequences.size() < n_seq;
+      });
+    });
+  } catch (runtime_error &e) {
+    std::cout << "Error while reading FASTA file " << path << "." << std::endl;
+    throw e;
+  }
+
+  warn_if_empty(path, sequences.size(), shuffled);
 
   if (shuffled)
     for (auto &s : sequences) {
@@ -235,17 +501,164 @@ void read_fasta(const string &path, vector<Entry> &sequences, bool revcomp,
     }
 };
 
+static const char cache_magic[] = "discrover corpus cache 1\n";
+
+/** Path of the cache file for a FASTA file and the options used to parse it */
+static string cache_path(const string &path, bool revcomp, size_t n_seq,
+                         bool shuffled) {
+  ifstream file(path, ios_base::binary);
+  if (not file)
+    throw Exception::File::Access(path);
+  sha1::Context context;
+  vector<char> buffer(1 << 20);
+  while (file) {
+    file.read(buffer.data(), buffer.size());
+    context.update(buffer.data(), file.gcount());
+  }
+  boost::filesystem::path cache_file(Cache::directory);
+  cache_file /= context.hexdigest() + "_r" + to_string(revcomp) + "_n"
+                + to_string(n_seq) + "_s" + to_string(shuffled) + ".cache";
+  return cache_file.string();
+}
+
+/** Append the entries of a cache file; returns false if the file is missing
+ * or corrupt, or if it was written for other random number generator states */
+static bool load_cache(const string &path, vector<IEntry> &entries) {
+  if (not boost::filesystem::exists(path))
+    return false;
+  try {
+    boost::iostreams::mapped_file_source file(path);
+    const char *pos = file.data(), *end = pos + file.size();
+    const size_t magic_size = sizeof(cache_magic) - 1;
+    if (file.size() < magic_size or memcmp(pos, cache_magic, magic_size) != 0)
+      return false;
+    pos += magic_size;
+    uint8_t uses_rng;
+    string state_before, state_after;
+    if (not read_binary(pos, end, uses_rng))
+      return false;
+    if (uses_rng
+        and (not read_binary(pos, end, state_before)
+             or not read_binary(pos, end, state_after)
+             or state_before != EntropySource::state()))
+      return false;
+    uint64_t n;
+    if (not read_binary(pos, end, n))
+      return false;
+    vector<IEntry> loaded;
+    for (size_t i = 0; i < n; i++) {
+      IEntry entry;
+      uint8_t both_strands;
+      if (not read_binary(pos, end, entry.definition)
+          or not read_binary(pos, end, both_strands)
+          or not entry.sequence.deserialize(pos, end))
+        return false;
+      entry.both_strands = both_strands;
+      loaded.push_back(move(entry));
+    }
+    if (pos != end)
+      return false;
+    if (uses_rng)
+      EntropySource::set_state(state_after);
+    move(loaded.begin(), loaded.end(), back_inserter(entries));
+    return true;
+  } catch (exception &e) {
+    return false;
+  }
+}
+
+/** Write entries to a cache file, along with the random number generator
+ * states before and after parsing if these differ */
+static void save_cache(const string &path,
+                       vector<IEntry>::const_iterator first,
+                       vector<IEntry>::const_iterator last,
+                       const string &state_before, const string &state_after) {
+  namespace fs = boost::filesystem;
+  boost::system::error_code ec;
+  fs::create_directories(Cache::directory, ec);
+  // write to a temporary file that is renamed, so that concurrent runs never
+  // see partially written cache files
+  fs::path tmp = fs::unique_path(path + ".%%%%-%%%%-%%%%", ec);
+  if (not ec) {
+    ofstream os(tmp.string(), ios_base::binary);
+    os.write(cache_magic, sizeof(cache_magic) - 1);
+    uint8_t uses_rng = state_before != state_after;
+    write_binary(os, uses_rng);
+    if (uses_rng) {
+      write_binary(os, state_before);
+      write_binary(os, state_after);
+    }
+    write_binary<uint64_t>(os, last - first);
+    for (; first != last; first++) {
+      write_binary(os, first->definition);
+      write_binary<uint8_t>(os, first->both_strands);
+      first->sequence.serialize(os);
+    }
+    os.close();
+    if (os)
+      fs::rename(tmp, path, ec);
+    else
+      ec = boost::system::errc::make_error_code(
+          boost::system::errc::io_error);
+  }
+  if (ec) {
+    fs::remove(tmp, ec);
+    cout << "Warning: could not write FASTA cache file " << path << "."
+         << endl;
+  }
+}
+
 void read_fasta(const string &path, vector<IEntry> &isequences, bool revcomp,
                 size_t n_seq, bool shuffled) {
-  vector<Entry> sequences;
-  read_fasta(path, sequences, revcomp, n_seq, shuffled);
-  for (auto &s : sequences) {
-    IEntry is(s);
-    if (revcomp)
-      is.sequence += "$" + reverse_complement(is.sequence);
-    is.isequence = string2seq(is.sequence);
-    isequences.push_back(is);
+  string cache_file, state_before;
+  if (not Cache::directory.empty() and boost::filesystem::exists(path)) {
+    cache_file = cache_path(path, revcomp, n_seq, shuffled);
+    if (load_cache(cache_file, isequences))
+      return;
+    state_before = EntropySource::state();
+  }
+  const size_t first = isequences.size();
+
+  // the reverse complementary strand is not stored but implied
+  if (shuffled) {
+    vector<Entry> sequences;
+    read_fasta(path, sequences, revcomp, n_seq, shuffled);
+    for (auto &s : sequences)
+      isequences.push_back(IEntry(s, revcomp));
+  } else {
+    // without shuffling, entries are packed as they are parsed
+    size_t n = 0;
+    try {
+      parse_file(path, [&](istream &is) {
+        parse_fasta(is, [&](Entry &entry) {
+          isequences.push_back(IEntry(entry, revcomp));
+          n++;
+          return n_seq == 0 or n < n_seq;
+        });
+      });
+    } catch (runtime_error &e) {
+      std::cout << "Error while reading FASTA file " << path << "."
+                << std::endl;
+      throw e;
+    }
+
+    warn_if_empty(path, n, shuffled);
   }
+
+  if (not cache_file.empty())
+    save_cache(cache_file, begin(isequences) + first, end(isequences),
+               state_before, EntropySource::state());
+};
+
+void read_fasta(const string &path, vector<PackedEntry> &sequences,
+                bool revcomp, size_t n_seq, bool shuffled) {
+  // the entries are parsed, and cached, like those of the HMM; seeding only
+  // considers the forward strands
+  vector<IEntry> isequences;
+  read_fasta(path, isequences, false, n_seq, shuffled);
+  sequences.reserve(sequences.size() + isequences.size());
+  for (auto &s : isequences)
+    sequences.push_back(PackedEntry(s));
 };
 }
 
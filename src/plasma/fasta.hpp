@@ -33,7 +33,8 @@
 #include <iostream>
 #include <vector>
 #include <random>
-#include <boost/numeric/ublas/vector.hpp>
+#include <cstdint>
+#include <functional>
 
 std::string reverse_complement(const std::string &s);
 
@@ -42,7 +43,6 @@ struct IEntry;
 struct Entry {
   Entry();
   Entry(const Entry &entry);
-  Entry(const IEntry &ientry);
   std::string definition;
   std::string sequence;
   std::string string(size_t width = 60) const {
@@ -51,15 +51,99 @@ struct Entry {
   std::string reverse_complement() const {
     return ::reverse_complement(sequence);
   };
-  size_t mask(const std::vector<size_t> &pos);
+  size_t size() const { return sequence.size(); };
 };
-struct IEntry : public Entry {
-  using alphabet_idx_t = unsigned char;
-  using seq_t = boost::numeric::ublas::vector<alphabet_idx_t>;
-  // using seq_t = std::vector<alphabet_idx_t>;
+/** A nucleic acid sequence packed to 2 bits per nucleotide
+ *
+ * Each position holds the code of a nucleotide: 0 to 3 for 'acgt'.
+ * Characters other than 'acgt' are assigned random nucleotides, or code 0
+ * if random_codes is false. To recover the text, upper case stretches and the
+ * stretches of characters differing from the lower case letter of their code,
+ * like runs of 'n', are kept in exception lists. */
+class PackedSequence {
+public:
+  using code_t = unsigned char;
+  PackedSequence(const std::string &s = "", bool random_codes = true);
+  size_t size() const { return length; };
+  code_t operator[](size_t i) const {
+    return (words[i / per_word] >> (2 * (i % per_word))) & 3;
+  };
+  /** The sequence in its original spelling */
+  std::string string() const;
+  /** Write the original spelling of positions first to last - 1 to out */
+  void decode(char *out, size_t first, size_t last) const;
+  bool operator==(const PackedSequence &other) const;
+  bool operator!=(const PackedSequence &other) const {
+    return not(*this == other);
+  };
+  /** Lexicographic comparison of the original spelling */
+  bool operator<(const PackedSequence &other) const;
+  /** Write a binary representation, for the corpus cache */
+  void serialize(std::ostream &os) const;
+  /** Read a binary representation written by serialize(), advancing pos;
+   * returns false if the data is truncated or inconsistent */
+  bool deserialize(const char *&pos, const char *end);
+
+private:
+  using word_t = uint64_t;
+  static const size_t per_word = 4 * sizeof(word_t);
+  /** Positions [begin, end) spelled with character c, or in upper case */
+  struct Run {
+    size_t begin, end;
+    char c;
+    bool operator==(const Run &other) const {
+      return begin == other.begin and end == other.end and c == other.c;
+    };
+  };
+  size_t length;
+  std::vector<word_t> words;
+  std::vector<Run> exceptions;
+  std::vector<Run> upper_case;
+  /** The letter for code 3; 'u' for sequences spelled with uracil */
+  char thymine;
+};
+
+std::ostream &operator<<(std::ostream &os, const PackedSequence &seq);
+
+struct IEntry {
+  using alphabet_idx_t = PackedSequence::code_t;
   static const alphabet_idx_t empty_symbol = 5;
-  seq_t isequence;
-  IEntry(const Entry &entry = Entry());
+  std::string definition;
+  PackedSequence sequence;
+  /** Whether the reverse complementary strand is to be considered, too.
+   * Only the forward strand is stored; symbol() presents both strands as if
+   * they were joined by an empty symbol, i.e. as "forward$revcomp". */
+  bool both_strands;
+  IEntry(const Entry &entry = Entry(), bool both_strands = false);
+  /** Number of symbols, including those of the reverse complementary strand */
+  size_t size() const {
+    return both_strands ? 2 * sequence.size() + 1 : sequence.size();
+  };
+  /** The symbol at position t; positions past the forward strand are those
+   * of the empty symbol and then of the reverse complementary strand */
+  alphabet_idx_t symbol(size_t t) const {
+    size_t n = sequence.size();
+    if (t < n)
+      return sequence[t];
+    else if (t == n)
+      return empty_symbol;
+    else
+      return 3 - sequence[2 * n - t];
+  };
+  /** The sequence, joined to its reverse complement if both strands are
+   * considered */
+  std::string strands() const;
+  size_t mask(const std::vector<size_t> &pos);
+};
+
+/** A sequence for seeding: packed like IEntry, but only the forward strand,
+ * and masked positions are spelled 'n' */
+struct PackedEntry {
+  std::string definition;
+  PackedSequence sequence;
+  PackedEntry(const Entry &entry = Entry());
+  PackedEntry(const IEntry &ientry);
+  size_t size() const { return sequence.size(); };
   size_t mask(const std::vector<size_t> &pos);
 };
 
@@ -76,18 +160,19 @@ Parser<typename std::decay<T>::type> make_parser(T &&t) {
 std::istream &operator>>(std::istream &is, Entry &entry);
 std::istream &operator>>(std::istream &is, IEntry &entry);
 
+/** Parse FASTA format entries from a stream, reading it in large blocks.
+ * For each entry fnc is called; parsing stops when it returns false. */
+void parse_fasta(std::istream &is, const std::function<bool(Entry &)> &fnc);
+
 template <class X>
 std::istream &operator>>(std::istream &is, Parser<X> &parser) {
-  bool proceed = true;
-  while (proceed and is.good()) {
-    Entry entry;
-    is >> entry;
-    proceed = parser(std::move(entry));
-  }
+  parse_fasta(is, [&](Entry &entry) { return parser(std::move(entry)); });
   return is;
 };
 
 std::ostream &operator<<(std::ostream &os, const Entry &entry);
+/** Writes the forward strand only */
+std::ostream &operator<<(std::ostream &os, const IEntry &entry);
 std::istream &operator>>(std::istream &is, std::vector<Entry> &parser);
 std::istream &operator>>(std::istream &is, std::vector<IEntry> &parser);
 
@@ -95,22 +180,61 @@ void read_fasta(const std::string &path, std::vector<Entry> &entries,
                 bool revcomp, size_t n_seq = 0, bool shuffled = false);
 void read_fasta(const std::string &path, std::vector<IEntry> &entries,
                 bool revcomp, size_t n_seq = 0, bool shuffled = false);
+void read_fasta(const std::string &path, std::vector<PackedEntry> &entries,
+                bool revcomp, size_t n_seq = 0, bool shuffled = false);
 
+/** On-disk cache of parsed, encoded, and shuffled FASTA files
+ *
+ * Cache files are named by the SHA1 of the FASTA file's content and the
+ * options that influence parsing. When the random number generators are used
+ * while parsing, their states are recorded so that a cache hit yields exactly
+ * the entries that parsing would have. Caching is disabled while the
+ * directory is empty. */
+struct Cache {
+  static std::string directory;
+};
+
+/** Random number generators for shuffling and for random nucleotides; each
+ * thread has its own */
 struct EntropySource {
   static void seed(size_t new_seed = std::random_device()()) {
     shuffling_rng.seed(new_seed);
     random_nucl_rng.seed(
         std::uniform_int_distribution<size_t>()(shuffling_rng));
   }
+  /** Draw a seed for an independent stream */
+  static size_t derive_seed() {
+    return std::uniform_int_distribution<size_t>()(shuffling_rng);
+  }
+  /** The states of the calling thread's generators in text form */
+  static std::string state();
+  /** Restore states returned by state() */
+  static void set_state(const std::string &state);
+  /** Seeds the generators of the calling thread while in scope and restores
+   * their previous state afterwards */
+  class Stream {
+  public:
+    Stream(size_t new_seed)
+        : shuffling(shuffling_rng), random_nucl(random_nucl_rng) {
+      seed(new_seed);
+    };
+    ~Stream() {
+      shuffling_rng = shuffling;
+      random_nucl_rng = random_nucl;
+    };
+
+  private:
+    std::mt19937 shuffling, random_nucl;
+  };
 
 private:
-  static std::mt19937 shuffling_rng, random_nucl_rng;
+  static thread_local std::mt19937 shuffling_rng, random_nucl_rng;
   friend void read_fasta(const std::string &path, std::vector<Entry> &entries,
                          bool revcomp, size_t n_seq, bool shuffled);
   friend void read_fasta(const std::string &path, std::vector<IEntry> &entries,
                          bool revcomp, size_t n_seq, bool shuffled);
-  friend IEntry::seq_t string2seq(const std::string &s, int n_enc);
   friend struct IEntry;
+  friend class PackedSequence;
 };
 }
 
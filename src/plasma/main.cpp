@@ -363,6 +363,7 @@ int main(int argc, const char **argv) {
   rng.seed(options.mcmc.random_salt);
 
   Fasta::EntropySource::seed(RandomDistribution::Uniform(rng));
+  Fasta::Cache::directory = options.cache_directory;
   MCMC::EntropySource::seed(RandomDistribution::Uniform(rng));
 
   try {
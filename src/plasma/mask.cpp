@@ -28,13 +28,15 @@ const bool update_sizes_on_removal = true;
 namespace Seeding {
 void remove_seqs_with_motif(const string &motif, Set &dataset,
                             const Options &options) {
-  auto pred = [&motif](const Fasta::Entry &entry) {
-    return search(begin(entry.sequence), end(entry.sequence), begin(motif),
-                  end(motif), iupac_included) != end(entry.sequence);
+  auto pred = [&motif](const Fasta::PackedEntry &entry) {
+    const string seq = entry.sequence.string();
+    return search(begin(seq), end(seq), begin(motif), end(motif),
+                  iupac_included) != end(seq);
   };
   dataset.sequences.erase(
       remove_if(begin(dataset.sequences), end(dataset.sequences), pred),
       end(dataset.sequences));
+  dataset.sort_by_length();
   if (update_sizes_on_removal) {
     dataset.set_size = dataset.sequences.size();
     dataset.seq_size = 0;
@@ -72,9 +74,14 @@ bool mask_motif_occurrences(const string &motif, string &seq,
   return false;
 }
 
-bool mask_motif_occurrences(const string &motif, Fasta::Entry &seq,
+bool mask_motif_occurrences(const string &motif, Fasta::PackedEntry &seq,
                             const Options &options, char mask_symbol) {
-  return mask_motif_occurrences(motif, seq.sequence, options, mask_symbol);
+  string s = seq.sequence.string();
+  if (not mask_motif_occurrences(motif, s, options, mask_symbol))
+    return false;
+  // as in PackedEntry::mask(), without drawing random nucleotides
+  seq.sequence = Fasta::PackedSequence(s, false);
+  return true;
 };
 
 void mask_motif_occurrences(const string &motif, Set &dataset,
@@ -32,6 +32,7 @@ Options::Options()
       pseudo_count(1),
       weighting(false),
       n_seq(0),
+      cache_directory(),
       word_stats(false),
       measure_runtime(false),
       occurrence_filter(OccurrenceFilter::RemoveSequences),
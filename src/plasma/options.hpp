@@ -104,6 +104,7 @@ struct Options {
   double pseudo_count;
   bool weighting;
   size_t n_seq;
+  std::string cache_directory;
   bool word_stats;
   bool measure_runtime;
   OccurrenceFilter occurrence_filter;
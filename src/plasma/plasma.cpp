@@ -19,6 +19,7 @@
 #include <fstream>
 #include <set>
 #include <thread>
+#include <omp.h>
 #include "plasma.hpp"
 #include "mask.hpp"
 #include "../aux.hpp"
@@ -66,9 +67,9 @@ Plasma::Plasma(const Options &opt)
     needs_rebuilding = true;
 }
 
-Plasma::Plasma(const Collection &collection_, const Options &opt)
+Plasma::Plasma(Collection collection_, const Options &opt)
     : options(opt),
-      collection(collection_),
+      collection(move(collection_)),
       needs_rebuilding(false) {
   if (options.verbosity >= Verbosity::verbose)
     cerr << "Data loaded - constructor 2." << endl;
@@ -194,8 +195,10 @@ Results Plasma::find_seeds(size_t length, const Objective &objective,
       degeneracies.insert(i);
 
   future<void> rebuilding_done;
-  if (needs_rebuilding and max_degeneracy > 0)
+  if (needs_rebuilding and max_degeneracy > 0) {
     rebuilding_done = rebuild_index();
+    needs_rebuilding = false;
+  }
 
   Results plasma_results;
   if ((algorithm & Algorithm::Plasma) == Algorithm::Plasma)
@@ -712,13 +715,23 @@ void Plasma::apply_mask(const vector<Result> &results) {
 }
 
 future<void> Plasma::rebuild_index() {
+  // the number of OpenMP threads is a per-thread setting, so it is passed on
+  const int n_threads = omp_get_max_threads();
   // wrap index rebuilding into a task
-  packaged_task<void()> task([&]() {
+  packaged_task<void()> task([&, n_threads]() {
+    omp_set_num_threads(n_threads);
     Timer my_timer;
+    // after masking, updating the index suffices
+    if (index.update(collection, options.allow_iupac_wildcards)) {
+      if (options.measure_runtime)
+        cerr << "Updated index in " + time_to_pretty_string(my_timer.tock())
+             << endl;
+      return;
+    }
     if (options.verbosity >= Verbosity::verbose)
       cerr << "Starting building of index." << endl;
-    index = NucleotideIndex<size_t, size_t>(
-        collection, options.allow_iupac_wildcards, options.verbosity);
+    index = CompactNucleotideIndex(collection, options.allow_iupac_wildcards,
+                                   options.verbosity);
     if (options.measure_runtime)
       cerr << "Built index in " + time_to_pretty_string(my_timer.tock())
            << endl;
@@ -734,24 +747,25 @@ future<void> Plasma::rebuild_index() {
 void viterbi_dump(const string &motif, const Set &dataset, ostream &out,
                   const Options &options) {
   out << "# " << dataset.path << " details following" << endl;
-  for (auto &seq : dataset) {
+  for (auto &entry : dataset) {
+    const string seq = entry.sequence.string();
     size_t n_sites = 0;
-    auto match_iter = begin(seq.sequence);
-    while ((match_iter = search(match_iter, end(seq.sequence), begin(motif),
+    auto match_iter = begin(seq);
+    while ((match_iter = search(match_iter, end(seq), begin(motif),
                                 end(motif), iupac_included))
-           != end(seq.sequence)) {
+           != end(seq)) {
       n_sites++;
       match_iter++;
     }
-    out << ">" << seq.definition << endl << "Viterbi #sites = " << n_sites
+    out << ">" << entry.definition << endl << "Viterbi #sites = " << n_sites
         << " Expected #sites = " << n_sites
         << " P(#sites>=1) = " << ((n_sites > 0) ? 1 : 0)
-        << " Viterbi log-p = nan" << endl << seq.sequence << endl;
-    auto pos_iter = begin(seq.sequence);
-    match_iter = begin(seq.sequence);
-    while ((match_iter = search(match_iter, end(seq.sequence), begin(motif),
+        << " Viterbi log-p = nan" << endl << seq << endl;
+    auto pos_iter = begin(seq);
+    match_iter = begin(seq);
+    while ((match_iter = search(match_iter, end(seq), begin(motif),
                                 end(motif), iupac_included))
-           != end(seq.sequence)) {
+           != end(seq)) {
       while (pos_iter++ != match_iter)
         out << "0";
       for (size_t j = 0; j < motif.length(); j++) {
@@ -760,7 +774,7 @@ void viterbi_dump(const string &motif, const Set &dataset, ostream &out,
       }
       pos_iter = match_iter;
     }
-    while (pos_iter++ != end(seq.sequence))
+    while (pos_iter++ != end(seq))
       out << "0";
     out << endl;
   }
@@ -778,25 +792,26 @@ void bed_dump(const string &motif, const Set &dataset, ostream &out,
   const size_t motif_length = motif.size();
   const string name = "site_";
   const size_t score = 0;
-  for (auto &seq : dataset) {
-    auto match_iter = begin(seq.sequence);
-    while ((match_iter = search(match_iter, end(seq.sequence), begin(motif),
+  for (auto &entry : dataset) {
+    const string seq = entry.sequence.string();
+    auto match_iter = begin(seq);
+    while ((match_iter = search(match_iter, end(seq), begin(motif),
                                 end(motif), iupac_included))
-           != end(seq.sequence)) {
-      size_t pos = std::distance(begin(seq.sequence), match_iter);
-      out << seq.definition << "\t" << pos << "\t" << (pos + motif_length)
+           != end(seq)) {
+      size_t pos = std::distance(begin(seq), match_iter);
+      out << entry.definition << "\t" << pos << "\t" << (pos + motif_length)
           << "\t" << name << (occ_idx++) << "\t" << score << "\t"
           << "+" << endl;
       match_iter++;
     }
     if (options.revcomp) {
       string rc_motif = reverse_complement(motif);
-      match_iter = begin(seq.sequence);
+      match_iter = begin(seq);
       while ((match_iter
-              = search(match_iter, end(seq.sequence), begin(rc_motif),
-                       end(rc_motif), iupac_included)) != end(seq.sequence)) {
-        size_t pos = std::distance(begin(seq.sequence), match_iter);
-        out << seq.definition << "\t" << pos << "\t" << (pos + motif_length)
+              = search(match_iter, end(seq), begin(rc_motif),
+                       end(rc_motif), iupac_included)) != end(seq)) {
+        size_t pos = std::distance(begin(seq), match_iter);
+        out << entry.definition << "\t" << pos << "\t" << (pos + motif_length)
             << "\t" << name << (occ_idx++) << "\t" << score << "\t"
             << "-" << endl;
         match_iter++;
@@ -45,11 +45,11 @@ public:
 
 private:
   bool needs_rebuilding;
-  NucleotideIndex<size_t, size_t> index;
+  CompactNucleotideIndex index;
 
 public:
   Plasma(const Options &options);
-  Plasma(const Collection &collection_, const Options &opt);
+  Plasma(Collection collection_, const Options &opt);
   Results find_motifs(const Specification::Motif &motif,
                       const Objective &objective, bool doreport = true) const;
   void apply_mask(const Results &results);
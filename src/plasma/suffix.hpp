@@ -35,6 +35,7 @@
 #include <cstddef>
 #include <vector>
 #include <stack>
+#include <limits>
 #include <numeric>
 #include <algorithm>
 #include "../timer.hpp"
@@ -64,7 +65,8 @@ X plusOne(X i) {
   return ++i;
 }
 
-/** A faster (linear-time) algorithm to construct the suffix array */
+/** A faster (linear-time) algorithm to construct the suffix array; large
+ * inputs are processed with as many threads as omp_get_max_threads() */
 template <bool shift, class idx_t, class Iter>
 std::vector<idx_t> gen_suffix_array(Iter begin, const Iter end,
                                     Verbosity verbosity) {
@@ -85,6 +87,7 @@ std::vector<idx_t> gen_suffix_array(Iter begin, const Iter end,
 
   std::vector<idx_t> sa(n + 3, 0);
   suffixArray(v.begin(), v.end(), sa, n, K + (shift ? 1 : 0));
+  sa.resize(n);
   double time = timer.tock();
   if (verbosity >= Verbosity::verbose)
     std::cerr << "Built SA in " + time_to_pretty_string(time) << std::endl;
@@ -111,6 +114,25 @@ std::vector<lcp_t> gen_lcp_slow(Iter begin, Iter end,
   return lcp;
 }
 
+/** The LCP values of the suffixes at positions first to last - 1, computed
+ * as by gen_lcp() below */
+template <class lcp_t, class idx_t, class Iter>
+void gen_lcp_block(Iter begin, const std::vector<idx_t> &sa,
+                   const std::vector<idx_t> &rank, std::vector<lcp_t> &lcp,
+                   idx_t first, idx_t last) {
+  const size_t max_lcp = std::numeric_limits<lcp_t>::max();
+  idx_t h = 0;
+  for (idx_t i = first; i < last; i++)
+    if (rank[i] > 0) {
+      idx_t j = sa[rank[i] - 1];
+      while (*(begin + i + h) == *(begin + j + h))
+        h++;
+      lcp[rank[i]] = std::min<size_t>(h, max_lcp);
+      if (h > 0)
+        h--;
+    }
+}
+
 /*  Pseudocode of linear time LCP array creation due to Kasai et al
  *  T. Kasai, G. Lee, H. Arimura, S. Arikawa, and K. Park.
  *  Linear-time longest-common-prefix computation in suffix arrays and its applications.
@@ -131,32 +153,38 @@ std::vector<lcp_t> gen_lcp_slow(Iter begin, Iter end,
  *      Height[Rank[i]] := h
  *      if h > 0:
  *        h := h-1
+ *
+ * LCP values exceeding the range of lcp_t are capped at its maximum.
+ *
+ * The text is split into contiguous blocks that are processed in parallel;
+ * each block starts with h = 0, which only costs the re-comparison of one
+ * common prefix per block.
  */
 template <class lcp_t, class idx_t, class Iter>
 std::vector<lcp_t> gen_lcp(Iter begin, Iter end, const std::vector<idx_t> &sa,
                            Verbosity verbosity) {
   Timer timer;
   idx_t n = std::distance(begin, end);
-  std::vector<idx_t> lcp(n), rank(n);
+  const int n_threads = constructionThreads(n);
+  std::vector<lcp_t> lcp(n);
+  std::vector<idx_t> rank(n);
+#pragma omp parallel for num_threads(n_threads)
   for (idx_t i = 0; i < n; i++)
     rank[sa[i]] = i;
-  idx_t h = 0;
-  for (idx_t i = 0; i < n; i++)
-    if (rank[i] > 0) {
-      idx_t j = sa[rank[i] - 1];
-      while (*(begin + i + h) == *(begin + j + h))
-        h++;
-      lcp[rank[i]] = h;
-      if (h > 0)
-        h--;
-    }
+  forEachBlock(n, n_threads, [&](idx_t first, idx_t last, int) {
+    gen_lcp_block(begin, sa, rank, lcp, first, last);
+  });
   double time = timer.tock();
   if (verbosity >= Verbosity::verbose)
     std::cerr << "Built LCP in " + time_to_pretty_string(time) << std::endl;
   return lcp;
 }
 
-// TODO use more efficient algorithm (although so far this is not a bottle-neck)
+/** Construct the JMP table: jmp[i] is the index of the next suffix after i
+ * whose LCP is less than or equal to that of suffix i, or n if there is none.
+ * The suffixes whose jump targets are pending are kept on a stack with
+ * non-decreasing LCPs; each suffix is pushed and popped once, so that this
+ * takes linear time even for repeat-rich sequences with long LCP plateaus. */
 // TODO another thought should be spent on the definition of the jmp pointer;
 // right now it's defined to be the next suffix with lcp <= to the current;
 // perhaps it might be helpful to use strictly less instead.
@@ -164,12 +192,14 @@ template <class idx_t, class lcp_t>
 std::vector<idx_t> gen_jmp(const std::vector<lcp_t> &lcp, Verbosity verbosity) {
   Timer timer;
   idx_t n = lcp.size();
-  std::vector<idx_t> jmp(n);
+  std::vector<idx_t> jmp(n, n);
+  std::vector<idx_t> pending;
   for (idx_t i = 0; i < n; i++) {
-    jmp[i] = i + 1;
-    size_t j = i + 1;
-    while (j < n and lcp[j++] > lcp[i])
-      jmp[i]++;
+    while (not pending.empty() and lcp[i] <= lcp[pending.back()]) {
+      jmp[pending.back()] = i;
+      pending.pop_back();
+    }
+    pending.push_back(i);
   }
   double time = timer.tock();
   if (verbosity >= Verbosity::verbose)
@@ -177,27 +207,9 @@ std::vector<idx_t> gen_jmp(const std::vector<lcp_t> &lcp, Verbosity verbosity) {
   return jmp;
 }
 
-template <class idx_t, class lcp_t>
-std::vector<idx_t> gen_jmp_var(const std::vector<lcp_t> &lcp) {
-  idx_t n = lcp.size();
-  std::vector<idx_t> jmp(n);
-
-  std::stack<std::pair<idx_t, lcp_t>> s;
-  s.push(std::make_pair(0, 0));
-  for (idx_t i = 1; i < n; i++) {
-    while (lcp[i] < s.top().second) {
-      jmp[s.top().first] = i;
-      s.pop();
-    }
-    s.push(std::make_pair(i, lcp[i]));
-  }
-  while (not s.empty()) {
-    jmp[s.top().first] = n;
-    s.pop();
-  }
-  return jmp;
-}
-
+/** Find the occurrences of a query. LCP values are only ever compared to
+ * lengths shorter than the query, so they may be capped at any value larger
+ * than the query length. */
 template <class lcp_t, class idx_t, class Iter,
           typename Cmp = std::equal_to<typename Iter::value_type>>
 std::vector<idx_t> match(Iter qbegin, Iter qend, Iter begin, Iter end,
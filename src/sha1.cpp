@@ -43,14 +43,6 @@ inline const unsigned int rol(const unsigned int value,
   return (value << steps) | (value >> (32 - steps));
 }
 
-// Sets the first 16 integers in the buffert to zero.
-// Used for clearing the W buffert.
-inline void clearWBuffert(unsigned int* buffert) {
-  for (int pos = 16; --pos >= 0;) {
-    buffert[pos] = 0;
-  }
-}
-
 void innerHash(unsigned int* result, unsigned int* w) {
   unsigned int a = result[0];
   unsigned int b = result[1];
@@ -104,53 +96,53 @@ void innerHash(unsigned int* result, unsigned int* w) {
 }
 }  // namespace
 
-void calc(const void* src, const int bytelength, unsigned char* hash) {
-  // Init the result array.
-  unsigned int result[5]
-      = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+Context::Context()
+    : result{0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0},
+      block_fill(0),
+      total(0) {}
 
-  // Cast the void src pointer to be the byte array we can work with.
-  const unsigned char* sarray = (const unsigned char*)src;
-
-  // The reusable round buffer
+void Context::process_block() {
   unsigned int w[80];
+  // This will swap endian on big endian and keep endian on little endian.
+  for (int roundPos = 0; roundPos < 16; roundPos++)
+    w[roundPos] = (unsigned int)block[4 * roundPos + 3]
+              | (((unsigned int)block[4 * roundPos + 2]) << 8)
+              | (((unsigned int)block[4 * roundPos + 1]) << 16)
+              | (((unsigned int)block[4 * roundPos    ]) << 24);
+  innerHash(result, w);
+  block_fill = 0;
+}
 
-  // Loop through all complete 64byte blocks.
-  const int endOfFullBlocks = bytelength - 64;
-  int endCurrentBlock;
-  int currentBlock = 0;
-
-  while (currentBlock <= endOfFullBlocks) {
-    endCurrentBlock = currentBlock + 64;
-
-    // Init the round buffer with the 64 byte block data.
-    for (int roundPos = 0; currentBlock < endCurrentBlock; currentBlock += 4) {
-      // This line will swap endian on big endian and keep endian on little
-      // endian.
-      w[roundPos++] = (unsigned int)sarray[currentBlock + 3]
-                  | (((unsigned int)sarray[currentBlock + 2]) << 8)
-                  | (((unsigned int)sarray[currentBlock + 1]) << 16)
-                  | (((unsigned int)sarray[currentBlock    ]) << 24);
-    }
-    innerHash(result, w);
+void Context::update(const void* src, size_t bytelength) {
+  const unsigned char* sarray = (const unsigned char*)src;
+  total += bytelength;
+  while (bytelength > 0) {
+    size_t n = 64 - block_fill;
+    if (n > bytelength)
+      n = bytelength;
+    for (size_t i = 0; i < n; i++)
+      block[block_fill + i] = sarray[i];
+    block_fill += n;
+    sarray += n;
+    bytelength -= n;
+    if (block_fill == 64)
+      process_block();
   }
+}
 
-  // Handle the last and not full 64 byte block if existing.
-  endCurrentBlock = bytelength - currentBlock;
-  clearWBuffert(w);
-  int lastBlockBytes = 0;
-  for (; lastBlockBytes < endCurrentBlock; ++lastBlockBytes) {
-    w[lastBlockBytes >> 2]
-        |= (unsigned int)sarray[lastBlockBytes + currentBlock]
-           << ((3 - (lastBlockBytes & 3)) << 3);
-  }
-  w[lastBlockBytes >> 2] |= 0x80 << ((3 - (lastBlockBytes & 3)) << 3);
-  if (endCurrentBlock >= 56) {
-    innerHash(result, w);
-    clearWBuffert(w);
+void Context::finish(unsigned char* hash) {
+  const uint64_t bitlength = total << 3;
+  block[block_fill++] = 0x80;
+  if (block_fill > 56) {
+    while (block_fill < 64)
+      block[block_fill++] = 0;
+    process_block();
   }
-  w[15] = bytelength << 3;
-  innerHash(result, w);
+  while (block_fill < 56)
+    block[block_fill++] = 0;
+  for (int i = 7; i >= 0; i--)
+    block[block_fill++] = (bitlength >> (8 * i)) & 0xff;
+  process_block();
 
   // Store hash in result pointer, and make sure we get in in the correct order
   // on both endian models.
@@ -160,6 +152,20 @@ void calc(const void* src, const int bytelength, unsigned char* hash) {
   }
 }
 
+std::string Context::hexdigest() {
+  unsigned char hash[20];
+  char hexstring[41];  // 40 chars + a zero
+  finish(hash);
+  toHexString(hash, hexstring);
+  return std::string(hexstring, 40);
+}
+
+void calc(const void* src, const int bytelength, unsigned char* hash) {
+  Context context;
+  context.update(src, bytelength);
+  context.finish(hash);
+}
+
 void toHexString(const unsigned char* hash, char* hexstring) {
   const char hexDigits[] = {"0123456789abcdef"};
 
@@ -28,8 +28,33 @@
 #ifndef SHA1_DEFINED
 #define SHA1_DEFINED
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
 namespace sha1 {
 
+/**
+ Incremental computation of a SHA1 hash, for data that arrives in pieces.
+ Feeding the data in any partition to update() yields the same hash as calc().
+ */
+class Context {
+ public:
+  Context();
+  void update(const void* src, size_t bytelength);
+  /** @param hash should point to a buffer of at least 20 bytes */
+  void finish(unsigned char* hash);
+  /** The hexadecimal representation of the hash */
+  std::string hexdigest();
+
+ private:
+  unsigned int result[5];
+  unsigned char block[64];
+  size_t block_fill;
+  uint64_t total;
+  void process_block();
+};
+
 /**
  @param src points to any kind of data to be hashed.
  @param bytelength the number of bytes to hash from the src pointer.
@@ -1,155 +1,186 @@
 #include "dinucleotide_shuffle.hpp"
-#include "../random_distributions.hpp"
-#include <cassert>
+#include <array>
+#include <cstdint>
 #include <vector>
-#include <map>
-#include <list>
-#include <iostream>
+#include <unordered_map>
 #include <random>
+#include <stdexcept>
 #include <algorithm>
-#include <boost/algorithm/string.hpp>
 
 using namespace std;
 
 // based on altschulEriksonDinuclShuffle.py
 // P. Clote, Oct 2003
-
-using Nucl = char;
-using Edge = pair<Nucl, Nucl>;
-using Nucls = list<Nucl>;
-using EdgeList = list<Edge>;
-using NuclCount = map<Nucl, size_t>;
-using DinuclCount = map<Edge, size_t>;
-
-using NuclList = map<Nucl, vector<Nucl>>;
-
-const string nuclList = "ACGTN";
-
-void computeCountAndLists(const string &s, NuclCount &nuclCnt,
-                          DinuclCount &dinuclCnt, NuclList &nl) {
-  // Compute count and lists
-  nuclCnt[s[0]] = 1;
-  size_t nuclTotal = 1;
-  size_t dinuclTotal = 0;
-  for (size_t i = 0; i < s.size() - 1; i++) {
-    Nucl x = s[i];
-    Nucl y = s[i + 1];
-    nl[x].push_back(y);
-    nuclCnt[y] += 1;
-    nuclTotal += 1;
-    dinuclCnt[make_pair(x, y)] += 1;
-    dinuclTotal += 1;
+//
+// A sequence is a path through the multigraph whose vertices are its
+// (k-1)-mers and whose edges are its k-mers. Shuffles preserving the k-mer
+// frequencies are the Eulerian paths through this graph that start and end
+// where the sequence does. Following Altschul and Erikson, a random one is
+// found by choosing for every vertex but the last the edge by which it is
+// left for the last time, such that these edges form a tree directed towards
+// the last vertex, and randomly permuting the other edges of each vertex.
+
+static const string nuclList = "ACGTN";
+static const size_t n_nucl = 5;
+
+using Nucl = uint8_t;
+
+/** Index in nuclList by character; U is T and other characters are N */
+static array<Nucl, 256> make_nucl_table() {
+  array<Nucl, 256> table;
+  table.fill(4);
+  const string nucls = "acgtu";
+  for (size_t i = 0; i < nucls.size(); i++) {
+    table[static_cast<unsigned char>(nucls[i])] = min<size_t>(i, 3);
+    table[static_cast<unsigned char>(toupper(nucls[i]))] = min<size_t>(i, 3);
   }
-  assert(nuclTotal == s.size());
-  assert(dinuclTotal == s.size() - 1);
+  return table;
 }
 
-template <class T>
-struct Eulerian {
-  bool valid;
-  EdgeList edges;
-  Nucls nucls;
-  char lastChar;
-
-  Eulerian() : valid(false), edges(), nucls(), lastChar('X'){};
-
-  Eulerian(const string &s, T &rng)
-      : valid(false), edges(), nucls(), lastChar(s.back()) {
-    NuclCount nuclCnt;
-    DinuclCount dinuclCnt;
-    NuclList nl;
-    computeCountAndLists(s, nuclCnt, dinuclCnt, nl);
-
-    // compute nucleotides appearing in s
-    for (Nucl x : "ACGTN")
-      if (s.find(x) != string::npos)
-        nucls.push_back(x);
-
-    for (Nucl x : nucls)
-      if (x != lastChar)
-        edges.push_back(make_pair(x, chooseEdge(x, dinuclCnt, rng)));
-
-    valid = connectedToLast();
-  };
-
-private:
-  bool connectedToLast() const {
-    map<Nucl, bool> D;
-    for (auto x : nucls)
-      D[x] = false;
-    for (auto &edge : edges)
-      if (edge.second == lastChar)
-        D[edge.first] = true;
-    for (size_t i = 0; i < 3; i++)
-      for (auto &edge : edges)
-        if (D[edge.second] == true)
-          D[edge.first] = true;
-    for (Nucl x : nucls)
-      if (x != lastChar and D[x] == false)
-        return false;
-    return true;
-  };
-
-  Nucl chooseEdge(Nucl x, DinuclCount dinuclCnt, T &rng) {
-    double z = RandomDistribution::Probability(rng);
-    double denom = 0;
-    for (auto y : "ACGTN") {
-      auto iter = dinuclCnt.find({x, y});
-      if (iter != end(dinuclCnt))
-        denom += iter->second;
-    }
-    double numerator = 0;
-    for (auto y : "ACGT") {
-      auto iter = dinuclCnt.find({x, y});
-      if (iter != end(dinuclCnt))
-        numerator += iter->second;
-      if (z < numerator / denom) {
-        dinuclCnt[{x, y}] -= 1;
-        return y;
-      }
-    }
-    dinuclCnt[{x, 'N'}] -= 1;
-    return 'N';
-  };
+static const array<Nucl, 256> nucl_table = make_nucl_table();
+
+static Nucl nucl(char c) { return nucl_table[static_cast<unsigned char>(c)]; }
+
+/** Multigraph with edges grouped by source vertex: the edges leaving vertex v
+ * lead to targets[offsets[v]] to targets[offsets[v + 1] - 1] */
+struct Graph {
+  vector<size_t> offsets;
+  vector<uint32_t> targets;
+  size_t degree(size_t v) const { return offsets[v + 1] - offsets[v]; };
 };
 
-string dinucleotideShuffle(const string &s_, size_t seed) {
-  if (s_.size() < 2)
-    return s_;
+/** Order the edges leaving each vertex as they are followed by a random
+ * Eulerian path that ends in vertex last */
+static void randomize_edges(Graph &g, size_t last, mt19937 &rng) {
+  const size_t n_vertices = g.offsets.size() - 1;
+
+  // Wilson's algorithm: loop-erased random walks yield a random tree of last
+  // edges directly, with the same distribution as choosing the last edges
+  // independently and retrying until they form a tree
+  vector<bool> in_tree(n_vertices, false);
+  vector<size_t> last_edge(n_vertices);
+  in_tree[last] = true;
+  for (size_t v = 0; v < n_vertices; v++) {
+    if (g.degree(v) == 0)
+      continue;
+    for (size_t u = v; not in_tree[u]; u = g.targets[last_edge[u]])
+      last_edge[u] = g.offsets[u] + uniform_int_distribution<size_t>(
+                                        0, g.degree(u) - 1)(rng);
+    for (size_t u = v; not in_tree[u]; u = g.targets[last_edge[u]])
+      in_tree[u] = true;
+  }
+
+  // move the last edges to the end and shuffle the others
+  for (size_t v = 0; v < n_vertices; v++) {
+    size_t first = g.offsets[v], end = g.offsets[v + 1];
+    if (first == end)
+      continue;
+    if (v != last)
+      swap(g.targets[last_edge[v]], g.targets[--end]);
+    shuffle(begin(g.targets) + first, begin(g.targets) + end, rng);
+  }
+}
+
+/** Append the labels of the vertices visited by following the edges of each
+ * vertex in order, starting from vertex first */
+static void walk(const Graph &g, size_t first, const string &labels,
+                 string &s) {
+  vector<size_t> next(begin(g.offsets), end(g.offsets) - 1);
+  size_t v = first;
+  for (size_t i = 0; i < g.targets.size(); i++) {
+    v = g.targets[next[v]++];
+    s += labels[v];
+  }
+}
+
+string dinucleotideShuffle(const string &s, size_t seed) {
+  if (s.size() < 2)
+    return s;
   mt19937 rng;
   rng.seed(seed);
-  string s(s_);
-  boost::algorithm::to_upper(s);
-  Eulerian<mt19937> eulerian;
-  while (not eulerian.valid)
-    eulerian = Eulerian<mt19937>(s, rng);
-
-  NuclCount nuclCnt;
-  DinuclCount dinuclCnt;
-  NuclList nl;
-  computeCountAndLists(s, nuclCnt, dinuclCnt, nl);
-
-  // remove last edges from each vertex list, shuffle, then add back
-  // the removed edges at end of vertex lists.
-  for (Edge x : eulerian.edges) {
-    auto &iter = nl.find(x.first)->second;
-    auto to_erase = find(begin(iter), end(iter), x.second);
-    iter.erase(to_erase);
+
+  array<array<size_t, n_nucl>, n_nucl> dinuclCnt = {};
+  for (size_t i = 0; i < s.size() - 1; i++)
+    dinuclCnt[nucl(s[i])][nucl(s[i + 1])]++;
+
+  // the vertices are the nucleotides
+  Graph g;
+  g.offsets.resize(n_nucl + 1);
+  g.targets.reserve(s.size() - 1);
+  for (Nucl x = 0; x < n_nucl; x++) {
+    g.offsets[x] = g.targets.size();
+    for (Nucl y = 0; y < n_nucl; y++)
+      g.targets.insert(end(g.targets), dinuclCnt[x][y], y);
   }
-  for (Nucl x : eulerian.nucls)
-    shuffle(begin(nl[x]), end(nl[x]), rng);
-  for (Edge x : eulerian.edges)
-    nl[x.first].push_back(x.second);
-
-  // construct the Eulerian path
-  string l = s.substr(0, 1);
-  Nucl prevCh = s[0];
-  for (size_t i = 0; i < s.size() - 2; i++) {
-    Nucl ch = nl[prevCh][0];
-    l += ch;
-    nl[prevCh].erase(begin(nl[prevCh]));
-    prevCh = ch;
+  g.offsets[n_nucl] = g.targets.size();
+
+  randomize_edges(g, nucl(s.back()), rng);
+
+  string l(1, nuclList[nucl(s[0])]);
+  l.reserve(s.size());
+  walk(g, nucl(s[0]), nuclList, l);
+  return l;
+}
+
+string kletShuffle(const string &s, size_t k, size_t seed) {
+  if (k < 1 or k > max_klet_length)
+    throw invalid_argument("k-let shuffles are only possible for k from 1 to "
+                           + to_string(max_klet_length) + ".");
+  if (s.size() < k)
+    return s;
+  if (k == 2)
+    return dinucleotideShuffle(s, seed);
+
+  mt19937 rng;
+  rng.seed(seed);
+
+  if (k == 1) {
+    string l;
+    l.reserve(s.size());
+    for (auto c : s)
+      l += nuclList[nucl(c)];
+    shuffle(begin(l), end(l), rng);
+    return l;
+  }
+
+  // the vertices are the (k-1)-mers, numbered in order of appearance and
+  // identified by their base 5 codes, with the last nucleotide least
+  // significant; they are labeled by their last nucleotide
+  uint64_t high = 1;
+  for (size_t i = 0; i < k - 2; i++)
+    high *= n_nucl;
+  const size_t n_edges = s.size() - k + 1;
+  vector<uint32_t> path(n_edges + 1);
+  unordered_map<uint64_t, uint32_t> ids;
+  string labels;
+  uint64_t code = 0;
+  for (size_t i = 0; i < s.size(); i++) {
+    code = (code % high) * n_nucl + nucl(s[i]);
+    if (i + 2 >= k) {
+      auto res = ids.insert({code, ids.size()});
+      if (res.second)
+        labels += nuclList[code % n_nucl];
+      path[i + 2 - k] = res.first->second;
+    }
   }
-  l += s.back();
+
+  Graph g;
+  g.offsets.assign(ids.size() + 1, 0);
+  g.targets.resize(n_edges);
+  for (size_t i = 0; i < n_edges; i++)
+    g.offsets[path[i] + 1]++;
+  for (size_t v = 0; v < ids.size(); v++)
+    g.offsets[v + 1] += g.offsets[v];
+  vector<size_t> fill(begin(g.offsets), end(g.offsets) - 1);
+  for (size_t i = 0; i < n_edges; i++)
+    g.targets[fill[path[i]]++] = path[i + 1];
+
+  randomize_edges(g, path[n_edges], rng);
+
+  string l;
+  l.reserve(s.size());
+  for (size_t i = 0; i < k - 1; i++)
+    l += nuclList[nucl(s[i])];
+  walk(g, path[0], labels, l);
   return l;
 }
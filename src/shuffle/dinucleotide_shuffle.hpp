@@ -1,8 +1,20 @@
 
 #ifndef DINUCLEOTIDE_SHUFFLE_HPP
+#define DINUCLEOTIDE_SHUFFLE_HPP
 
 #include <string>
 
+/** The largest k for which kletShuffle() is supported */
+const size_t max_klet_length = 28;
+
+/** Shuffle preserving the dinucleotide frequencies as well as the first and
+ * last nucleotide. The result is in upper case; characters other than ACGTU
+ * are treated as N, and U as T. */
 std::string dinucleotideShuffle(const std::string &s, size_t seed);
 
+/** Shuffle preserving the frequencies of k-mers, for 1 <= k <= 28, as well as
+ * the first and last k-1 nucleotides. Sequences shorter than k are returned
+ * unchanged; otherwise as for dinucleotideShuffle(). */
+std::string kletShuffle(const std::string &s, size_t k, size_t seed);
+
 #endif
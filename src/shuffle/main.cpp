@@ -16,6 +16,7 @@
 #include <cstddef>
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
+#include <omp.h>
 #include <string>
 #include <vector>
 #include "../random_distributions.hpp"
@@ -31,6 +32,7 @@ std::string gen_usage_string() {
   const std::string usage = "Generates dinucleotide frequency preserving shuffles of FASTA files.\n"
     "\n"
     "If no paths are given, sequences are read from standard input.\n"
+    "With -k, the frequencies of longer k-mers are preserved instead.\n"
     "\n"
     "The code is based on altschulEriksonDinuclShuffle.py by P. Clote, from Oct 2003.\n";
   return usage;
@@ -38,30 +40,45 @@ std::string gen_usage_string() {
 
 using namespace std;
 
-void shuffle(istream &is, size_t n, size_t seed) {
+/** Generate n shuffles of each of the entries in parallel and print them in
+ * order. The seeds of the shuffles are drawn in order from rng, so that the
+ * output does not depend on the number of threads. */
+void shuffle_batch(const vector<Fasta::Entry> &entries, size_t n, size_t k,
+                   mt19937 &rng) {
+  vector<size_t> seeds(entries.size() * n);
+  for (auto &seed : seeds)
+    seed = RandomDistribution::Uniform(rng);
+  vector<string> shuffles(seeds.size());
+#pragma omp parallel for schedule(dynamic)
+  for (size_t i = 0; i < shuffles.size(); i++)
+    shuffles[i] = kletShuffle(entries[i / n].sequence, k, seeds[i]);
+  for (size_t i = 0; i < shuffles.size(); i++)
+    cout << ">" << entries[i / n].definition << endl << shuffles[i] << endl;
+}
+
+void shuffle(istream &is, size_t n, size_t k, size_t seed) {
+  // entries are processed in batches to bound memory usage
+  const size_t batch_size = 1024;
   mt19937 rng;
   rng.seed(seed);
-  auto parsing = [&n, &seed, &rng](Fasta::Entry &&entry) {
-    for (size_t i = 0; i < n; i++) {
-      string seq = entry.sequence;
-      for (auto &s : seq) {
-        s = tolower(s);
-        if (s == 'u')
-          s = 't';
-      }
-      cout << ">" << entry.definition << endl
-           << dinucleotideShuffle(seq, RandomDistribution::Uniform(rng)) << endl;
+  vector<Fasta::Entry> batch;
+  Fasta::parse_fasta(is, [&](Fasta::Entry &entry) {
+    batch.push_back(move(entry));
+    if (batch.size() == batch_size) {
+      shuffle_batch(batch, n, k, rng);
+      batch.clear();
     }
     return true;
-  };
-  auto parser = Fasta::make_parser(parsing);
-  is >> parser;
+  });
+  shuffle_batch(batch, n, k, rng);
 }
 
 int main(int argc, const char **argv) {
   vector<string> paths;
   size_t n = 1;
+  size_t k = 2;
   size_t seed = 1;
+  size_t n_threads = omp_get_num_procs();
   Verbosity verbosity = Verbosity::info;
 
   namespace po = boost::program_options;
@@ -78,6 +95,8 @@ int main(int argc, const char **argv) {
        "Note: usage of -f / --fasta is optional; all free arguments are taken to be paths of FASTA files."
       )
       ("number,n", po::value(&n)->default_value(1), "How many shuffles to generate per sequence.")
+      ("klet,k", po::value(&k)->default_value(2), "Preserve the frequencies of k-mers of this length. 2 preserves dinucleotide frequencies, 1 only the nucleotide composition. At most 28.")
+      ("threads", po::value(&n_threads), "Number of threads. If not given, as many are used as there are CPU cores on this machine.")
       ("seed,s", po::value(&seed), "Seed to initialize random number generator.")
       ("verbose,v", "Be verbose about the progress")
       ;
@@ -231,17 +250,25 @@ int main(int argc, const char **argv) {
     return EXIT_FAILURE;
   }
 
+  if (k < 1 or k > max_klet_length) {
+    cout << "Error: the k-mer length given with -k / --klet must be between 1 "
+            "and " << max_klet_length << "." << endl;
+    return EXIT_FAILURE;
+  }
+
   if (not vm.count("seed"))
     seed = random_device()();
 
+  omp_set_num_threads(n_threads);
+
   try {
     if (paths.empty()) {
-      shuffle(cin, n, seed);
+      shuffle(cin, n, k, seed);
     } else
       for (auto &path : paths) {
         if (boost::filesystem::exists(path)) {
           ifstream ifs(path.c_str());
-          shuffle(ifs, n, seed++);
+          shuffle(ifs, n, k, seed++);
         } else
           throw Exception::File::Existence(path);
       }